@@ -3,14 +3,17 @@
 
 #ifdef VIOLET_IMPLEMENTATION
 #define ARRAY_IMPLEMENTATION
+#define ATOM_IMPLEMENTATION
 #define CORE_IMPLEMENTATION
 #define DMATH_IMPLEMENTATION
 #define FMATH_IMPLEMENTATION
 #define GRAPHICS_IMPLEMENTATION
 #define GUI_IMPLEMENTATION
+#define HASHMAP_IMPLEMENTATION
 #define IMATH_IMPLEMENTATION
 #define LIST_IMPLEMENTATION
 #define OS_IMPLEMENTATION
+#define RING_IMPLEMENTATION
 #define STRING_IMPLEMENTATION
 #define VSON_IMPLEMENTATION
 #undef VIOLET_IMPLEMENTATION
@@ -20,7 +23,10 @@
 #include "violet/core.h"
 /* Data structures */
 #include "violet/array.h"
+#include "violet/hashmap.h"
+#include "violet/atom.h"
 #include "violet/list.h"
+#include "violet/ring.h"
 /* Math */
 #include "violet/dmath.h"
 #include "violet/fmath.h"
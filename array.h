@@ -32,6 +32,32 @@ typedef struct array__head
 #define array_init(a, cap)         array_init_ex(a, cap, g_allocator)
 #define array_init_ex(a, cap, alc) (a)=array__create(cap, sizeof(*a), alc \
                                                      MEMCALL_LOCATION)
+#define array_init_aligned(a, cap, align) \
+                                   array_init_aligned_ex(a, cap, align, g_allocator)
+#define array_init_aligned_ex(a, cap, align, alc) \
+                                   (a)=array__create_aligned(cap, sizeof(*a), align, \
+                                                             alc  MEMCALL_LOCATION)
+/* Small-buffer arrays - storage holds the head & the first n elements inline,
+ * so no allocation happens until the array outgrows them. The array points
+ * into storage, which must outlive it and must not be moved or copied.
+ * The prefix & head are rounded up to the element alignment so the head ends
+ * exactly where the elements start - hdr's size goes negative (a compile
+ * error) if that would leave the prefix misaligned. */
+#define array__sbo_hdr_bytes       (sizeof(array__sbo_prefix) + sizeof(array__head))
+#define array__sbo_hdr_round(type) ((array__sbo_hdr_bytes + _Alignof(type) - 1) \
+                                    / _Alignof(type) * _Alignof(type))
+#define array__sbo_hdr_sz(type)    (  (array__sbo_hdr_round(type) - array__sbo_hdr_bytes) \
+                                    % _Alignof(array__sbo_prefix) == 0 \
+                                    ? (long)array__sbo_hdr_round(type) : -1)
+#define array_sbo_storage(type, n) struct { _Alignas(array__sbo_prefix) _Alignas(type) \
+                                            unsigned char hdr[array__sbo_hdr_sz(type)]; \
+                                            type data[n]; }
+#define array_init_sbo(a, storage) array_init_sbo_ex(a, storage, g_allocator)
+#define array_init_sbo_ex(a, storage, alc) \
+                                   (a)=array__init_sbo((storage).data, \
+                                                       countof((storage).data), \
+                                                       sizeof(*a), alc)
+#define array_is_inline(a)         array__is_inline(a)
 #define array_destroy(a)           afree(array__get_head(a), array__allocator(a))
 
 #define array__esz(a)              (sizeof(*(a)))
@@ -65,8 +91,27 @@ typedef struct array__head
 #define array_insert_fast(a, i, e) ((a)=array__append_null(a, array__esz(a) \
                                                            MEMCALL_LOCATION), \
                                     array_last(a) = (a)[(i)], (a)[(i)] = (e))
+/* Bulk operations - p must not point into a, since a may be reallocated */
+#define array_append_n(a, p, n)    array_splice(a, array_sz(a), 0, p, n)
+#define array_append_null_n(a, n)  (array_append_n(a, NULL, n), array_end(a) - (n))
+#define array_insert_n(a, i, p, n) array_splice(a, i, 0, p, n)
+#define array_insert_null_n(a, i, n) \
+                                   (array_insert_n(a, i, NULL, n), (a)+(i))
+/* replace n_remove elements at i with n_insert elements from p (if not NULL) */
+#define array_splice(a, i, n_remove, p, n_insert) \
+                                   ((a)=array__splice(a, i, n_remove, p, n_insert, \
+                                                      array__esz(a)  MEMCALL_LOCATION))
 #define array_remove(a, i)         array_remove_n(a, i, 1)
 #define array_remove_n(a, i, n)    array__remove(a, i, n, array__esz(a))
+/* stable - removes every element for which cond (on type *it) holds */
+#define array_remove_if(a, type, it, cond) \
+                                   do { \
+                                     type *array__dst_ = (a); \
+                                     array_foreach(a, type, it) \
+                                       if (!(cond)) \
+                                         *array__dst_++ = *it; \
+                                     array_sz(a) = (array_size_t)(array__dst_ - (a)); \
+                                   } while (0)
 #define array_remove_fast(a, i)    array__remove_fast(a, i, array__esz(a))
 #define array_pop(a)               (--array_sz(a))
 #define array_clear(a)             (array_sz(a) = 0)
@@ -86,13 +131,219 @@ typedef struct array__head
 
 #define A2PN(a)                    (a), array_sz(a)
 
+/* Type-specialized sorting & searching
+ *
+ * ARRAY_SORT_DEFINE(name, type, key_type, key) generates functions for
+ * elements ordered by key(const type *), compared with <:
+ *   void  name_sort(type *a, array_size_t n)              introsort, unstable
+ *   type *name_lower(type *a, array_size_t n, key_type k) first key >= k
+ *   type *name_upper(type *a, array_size_t n, key_type k) first key >  k
+ * The bounds are branchless & return a + n when no element qualifies.
+ *
+ * ARRAY_RADIX_SORT_DEFINE(name, type, radix_key) generates a stable LSD
+ * radix sort for elements with an integer or float key, where radix_key
+ * (const type *) maps the key to an order-preserving u64 - see
+ * array_radix_key_*. Byte positions shared by all keys are skipped:
+ *   void  name_radix_sort(type *a, array_size_t n, allocator_t *alc)
+ */
+#define array_sort(a, name)              name##_sort(a, array_sz(a))
+#define array_radix_sort(a, name)        name##_radix_sort(a, array_sz(a), \
+                                                           g_temp_allocator)
+#define array_lower_bound(a, name, k)    name##_lower(a, array_sz(a), k)
+#define array_upper_bound(a, name, k)    name##_upper(a, array_sz(a), k)
+
+#ifndef ARRAY_INSERTION_SORT_MAX
+#define ARRAY_INSERTION_SORT_MAX 16
+#endif
+
+#define array__swap(type, x, y) do { type tmp_ = x; x = y; y = tmp_; } while (0)
+
+#define ARRAY_SORT_DEFINE(name, type, key_type, key) \
+static inline \
+void name##__insertion_sort(type *a, array_size_t n) \
+{ \
+	for (array_size_t i = 1; i < n; ++i) { \
+		const type tmp = a[i]; \
+		array_size_t j = i; \
+		for (; j > 0 && key(&tmp) < key(&a[j-1]); --j) \
+			a[j] = a[j-1]; \
+		a[j] = tmp; \
+	} \
+} \
+static inline \
+void name##__sift_down(type *a, array_size_t i, array_size_t n) \
+{ \
+	const type tmp = a[i]; \
+	for (array_size_t c; (c = 2 * i + 1) < n; i = c) { \
+		if (c + 1 < n && key(&a[c]) < key(&a[c+1])) \
+			++c; \
+		if (!(key(&tmp) < key(&a[c]))) \
+			break; \
+		a[i] = a[c]; \
+	} \
+	a[i] = tmp; \
+} \
+static inline \
+void name##__heap_sort(type *a, array_size_t n) \
+{ \
+	for (array_size_t i = n / 2; i > 0; --i) \
+		name##__sift_down(a, i - 1, n); \
+	for (array_size_t i = n - 1; i > 0; --i) { \
+		array__swap(type, a[0], a[i]); \
+		name##__sift_down(a, 0, i); \
+	} \
+} \
+static inline \
+void name##__intro_sort(type *a, array_size_t n, u32 depth) \
+{ \
+	while (n > ARRAY_INSERTION_SORT_MAX) { \
+		const array_size_t mid = n / 2; \
+		array_size_t i = 0, j = n - 1; \
+		key_type pivot; \
+		if (depth-- == 0) { \
+			name##__heap_sort(a, n); \
+			return; \
+		} \
+		/* median of 3 - also places sentinels at both ends */ \
+		if (key(&a[mid]) < key(&a[0])) \
+			array__swap(type, a[mid], a[0]); \
+		if (key(&a[n-1]) < key(&a[mid])) { \
+			array__swap(type, a[n-1], a[mid]); \
+			if (key(&a[mid]) < key(&a[0])) \
+				array__swap(type, a[mid], a[0]); \
+		} \
+		pivot = key(&a[mid]); \
+		for (;;) { \
+			while (key(&a[++i]) < pivot); \
+			while (pivot < key(&a[--j])); \
+			if (i >= j) \
+				break; \
+			array__swap(type, a[i], a[j]); \
+		} \
+		/* recurse into the smaller half, loop on the larger one */ \
+		if (i < n - i) { \
+			name##__intro_sort(a, i, depth); \
+			a += i; \
+			n -= i; \
+		} else { \
+			name##__intro_sort(a + i, n - i, depth); \
+			n = i; \
+		} \
+	} \
+	name##__insertion_sort(a, n); \
+} \
+static inline \
+void name##_sort(type *a, array_size_t n) \
+{ \
+	u32 depth = 0; \
+	for (array_size_t m = n; m > 1; m >>= 1) \
+		depth += 2; \
+	name##__intro_sort(a, n, depth); \
+} \
+static inline \
+type *name##_lower(type *a, array_size_t n, key_type k) \
+{ \
+	type *base = a; \
+	if (n == 0) \
+		return a; \
+	while (n > 1) { \
+		const array_size_t half = n / 2; \
+		base = key(&base[half]) < k ? base + half : base; \
+		n -= half; \
+	} \
+	return base + (key(base) < k); \
+} \
+static inline \
+type *name##_upper(type *a, array_size_t n, key_type k) \
+{ \
+	type *base = a; \
+	if (n == 0) \
+		return a; \
+	while (n > 1) { \
+		const array_size_t half = n / 2; \
+		base = k < key(&base[half]) ? base : base + half; \
+		n -= half; \
+	} \
+	return base + !(k < key(base)); \
+}
+
+#define ARRAY_RADIX_SORT_DEFINE(name, type, radix_key) \
+static inline \
+void name##_radix_sort(type *a, array_size_t n, allocator_t *alc) \
+{ \
+	array_size_t counts[8][256] = {0}; \
+	type *src = a, *dst, *tmp; \
+	if (n < 2) \
+		return; \
+	for (array_size_t i = 0; i < n; ++i) { \
+		const u64 k = radix_key(&a[i]); \
+		for (u32 d = 0; d < 8; ++d) \
+			++counts[d][(k >> (8 * d)) & 0xff]; \
+	} \
+	tmp = dst = amalloc(n * sizeof(type), alc); \
+	error_if(!tmp, "radix_sort: oom"); \
+	for (u32 d = 0; d < 8; ++d) { \
+		array_size_t *count = counts[d], offset = 0; \
+		if (count[(radix_key(&src[0]) >> (8 * d)) & 0xff] == n) \
+			continue; \
+		for (u32 b = 0; b < 256; ++b) { \
+			const array_size_t c = count[b]; \
+			count[b] = offset; \
+			offset += c; \
+		} \
+		for (array_size_t i = 0; i < n; ++i) \
+			dst[count[(radix_key(&src[i]) >> (8 * d)) & 0xff]++] = src[i]; \
+		array__swap(type*, src, dst); \
+	} \
+	if (src != a) \
+		memcpy(a, src, n * sizeof(type)); \
+	afree(tmp, alc); \
+}
+
+/* Order-preserving radix keys */
+static inline u64 array_radix_key_u32(u32 x) { return x; }
+static inline u64 array_radix_key_s32(s32 x) { return (u32)x ^ 0x80000000u; }
+static inline u64 array_radix_key_u64(u64 x) { return x; }
+static inline u64 array_radix_key_s64(s64 x) { return (u64)x ^ 0x8000000000000000ull; }
+static inline
+u64 array_radix_key_r32(r32 x)
+{
+	u32 u;
+	memcpy(&u, &x, sizeof(u));
+	/* negative: flip all bits, positive: flip the sign bit */
+	return u ^ ((u32)-(s32)(u >> 31) | 0x80000000u);
+}
+static inline
+u64 array_radix_key_r64(r64 x)
+{
+	u64 u;
+	memcpy(&u, &x, sizeof(u));
+	return u ^ ((u64)-(s64)(u >> 63) | 0x8000000000000000ull);
+}
+
 
 ARRDEF void *array__create(array_size_t cap, size_t sz, allocator_t *a
                            MEMCALL_ARGS);
+ARRDEF void *array__create_aligned(array_size_t cap, size_t sz, size_t alignment,
+                                   allocator_t *a  MEMCALL_ARGS);
+typedef struct array__sbo_prefix
+{
+	allocator_t allocator;
+	allocator_t *parent;
+	size_t bytes;
+} array__sbo_prefix;
+
+ARRDEF void *array__init_sbo(void *data, array_size_t cap, size_t sz,
+                             allocator_t *a);
+ARRDEF b32   array__is_inline(const void *a);
 ARRDEF void *array__reserve(void *a, array_size_t nmemb, size_t sz
                             MEMCALL_ARGS);
 ARRDEF void *array__copy(void *dst, const void *src, size_t sz  MEMCALL_ARGS);
 ARRDEF void *array__grow(void *a, size_t sz  MEMCALL_ARGS);
+ARRDEF void *array__grow_n(void *a, array_size_t n, size_t sz  MEMCALL_ARGS);
+ARRDEF void *array__splice(void *a, array_size_t idx, array_size_t n_remove,
+                           const void *src, array_size_t n_insert, size_t sz
+                           MEMCALL_ARGS);
 ARRDEF void *array__append_null(void *a, size_t sz  MEMCALL_ARGS);
 ARRDEF void *array__insert_null(void *a, array_size_t idx, size_t sz
                                 MEMCALL_ARGS);
@@ -123,6 +374,134 @@ ARRDEF void *array__create(array_size_t cap, size_t sz, allocator_t *a
 	return head + 1;
 }
 
+/*
+ * An aligned array is prefixed by a copy of its allocator whose realloc_ &
+ * free_ keep the elements aligned - head->allocator points to it, so the
+ * rest of the array code doesn't need to know about alignment:
+ *   [padding | array__aligned_prefix | array__head | elements...]
+ * Only the array itself should be resized or freed through that allocator.
+ */
+typedef struct array__aligned_prefix
+{
+	allocator_t allocator;
+	allocator_t *parent;
+	size_t alignment;
+} array__aligned_prefix;
+
+static
+size_t array__aligned_offset(size_t alignment)
+{
+	const size_t sz = sizeof(array__aligned_prefix) + sizeof(array__head);
+	return (sz + alignment - 1) & ~(alignment - 1);
+}
+
+static
+void array__aligned_free(void *head, allocator_t *a  MEMCALL_ARGS)
+{
+	const array__aligned_prefix *prefix = (array__aligned_prefix*)a;
+	allocator_t *parent = prefix->parent;
+	if (head)
+		parent->free_((arr_bytep)head + sizeof(array__head)
+		              - array__aligned_offset(prefix->alignment), parent  MEMCALL_VARS);
+}
+
+static
+void *array__aligned_realloc(void *head_, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	const array__aligned_prefix *prefix = (array__aligned_prefix*)a;
+	allocator_t *parent = prefix->parent;
+	const size_t alignment = prefix->alignment;
+	const size_t offset = array__aligned_offset(alignment);
+	arr_bytep block = (arr_bytep)head_ + sizeof(array__head) - offset;
+	array__head *head;
+	assert(head_);
+	if (!size) {
+		array__aligned_free(head_, a  MEMCALL_VARS);
+		return NULL;
+	}
+	block = parent->realloc_aligned_(block, offset - sizeof(array__head) + size,
+	                                 alignment, parent  MEMCALL_VARS);
+	if (!block)
+		return NULL;
+	head = (array__head*)(block + offset) - 1;
+	head->allocator = &((array__aligned_prefix*)head - 1)->allocator;
+	return head;
+}
+
+ARRDEF void *array__create_aligned(array_size_t cap, size_t sz, size_t alignment,
+                                   allocator_t *a  MEMCALL_ARGS)
+{
+	const size_t offset = array__aligned_offset(alignment);
+	arr_bytep block = a->malloc_aligned_(offset + cap * sz, alignment, a  MEMCALL_VARS);
+	array__aligned_prefix *prefix;
+	array__head *head;
+	error_if(!block, "array__create_aligned: oom");
+	head = (array__head*)(block + offset) - 1;
+	prefix = (array__aligned_prefix*)head - 1;
+	prefix->allocator          = *a;
+	prefix->allocator.realloc_ = array__aligned_realloc;
+	prefix->allocator.free_    = array__aligned_free;
+	prefix->parent             = a;
+	prefix->alignment          = alignment;
+	head->sz = 0;
+	head->cap = cap;
+	head->allocator = &prefix->allocator;
+	return head + 1;
+}
+
+/*
+ * A small-buffer array starts out in caller-provided storage:
+ *   [padding | array__sbo_prefix | array__head | n inline elements]
+ * Like an aligned array, head->allocator points to a modified copy of the
+ * parent allocator in the prefix. Its free_ ignores the inline block, and its
+ * realloc_ moves the array to the parent allocator - from then on the array
+ * is an ordinary one & the inline storage is left unused.
+ */
+static
+void array__sbo_free(void *head, allocator_t *a  MEMCALL_ARGS)
+{
+	assert(!head || (array__sbo_prefix*)head - 1 == (array__sbo_prefix*)a);
+}
+
+static
+void *array__sbo_realloc(void *head_, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	const array__sbo_prefix *prefix = (array__sbo_prefix*)a;
+	allocator_t *parent = prefix->parent;
+	array__head *head;
+	assert(head_ && (array__sbo_prefix*)head_ - 1 == prefix);
+	if (!size)
+		return NULL;
+	head = parent->malloc_(size, parent  MEMCALL_VARS);
+	if (!head)
+		return NULL;
+	memcpy(head, head_, size < prefix->bytes ? size : prefix->bytes);
+	head->allocator = parent;
+	return head;
+}
+
+ARRDEF void *array__init_sbo(void *data, array_size_t cap, size_t sz,
+                             allocator_t *a)
+{
+	array__head *head = array__get_head(data);
+	array__sbo_prefix *prefix = (array__sbo_prefix*)head - 1;
+	prefix->allocator          = *a;
+	prefix->allocator.realloc_ = array__sbo_realloc;
+	prefix->allocator.free_    = array__sbo_free;
+	prefix->parent             = a;
+	prefix->bytes              = sizeof(array__head) + cap * sz;
+	head->sz = 0;
+	head->cap = cap;
+	head->allocator = &prefix->allocator;
+	return data;
+}
+
+ARRDEF b32 array__is_inline(const void *a)
+{
+	const array__head *head = array__get_head(a);
+	return head->allocator->free_ == array__sbo_free;
+}
+
 ARRDEF void *array__reserve(void *array, array_size_t nmemb, size_t sz
                             MEMCALL_ARGS)
 {
@@ -153,6 +532,32 @@ ARRDEF void *array__grow(void *a, size_t sz  MEMCALL_ARGS)
 		return a;
 }
 
+ARRDEF void *array__grow_n(void *a, array_size_t n, size_t sz  MEMCALL_ARGS)
+{
+	const array_size_t needed = array_sz(a) + n, grown = array_cap(a)*3/2+1;
+	if (needed > array_cap(a))
+		return array__reserve(a, needed > grown ? needed : grown, sz  MEMCALL_VARS);
+	else
+		return a;
+}
+
+ARRDEF void *array__splice(void *a, array_size_t idx, array_size_t n_remove,
+                           const void *src, array_size_t n_insert, size_t sz
+                           MEMCALL_ARGS)
+{
+	const array_size_t tail = array_sz(a) - idx - n_remove;
+	assert(idx + n_remove <= array_sz(a));
+	if (n_insert > n_remove)
+		a = array__grow_n(a, n_insert - n_remove, sz  MEMCALL_VARS);
+	if (n_insert != n_remove && tail)
+		memmove((arr_bytep)a + (idx + n_insert) * sz,
+		        (arr_bytep)a + (idx + n_remove) * sz, tail * sz);
+	if (src)
+		memcpy((arr_bytep)a + idx * sz, src, n_insert * sz);
+	array_sz(a) = idx + n_insert + tail;
+	return a;
+}
+
 ARRDEF void *array__append_null(void *a, size_t sz  MEMCALL_ARGS)
 {
 	a = array__grow(a, sz  MEMCALL_VARS);
@@ -163,23 +568,16 @@ ARRDEF void *array__append_null(void *a, size_t sz  MEMCALL_ARGS)
 ARRDEF void *array__insert_null(void *a, array_size_t idx, size_t sz
                                 MEMCALL_ARGS)
 {
-	a = array__append_null(a, sz  MEMCALL_VARS);
 	assert(idx <= array_sz(a));
-	for (arr_bytep p = (arr_bytep)a+(array_sz(a)-1)*sz,
-	               end = (arr_bytep)a+idx*sz;
-	     p != end; p -= sz)
-		memcpy(p, p - sz, sz);
-	return a;
+	return array__splice(a, idx, 0, NULL, 1, sz  MEMCALL_VARS);
 }
 
 ARRDEF void array__remove(void *a, array_size_t idx, array_size_t n, size_t sz)
 {
 	assert(n > 0);
 	assert(idx + n - 1 < array_sz(a));
-	for (arr_bytep p = (arr_bytep)a + (idx + n) * sz,
-	               end = (arr_bytep)a + array_sz(a) * sz;
-	     p != end; p += sz)
-		memcpy(p - n * sz, p, sz);
+	memmove((arr_bytep)a + idx * sz, (arr_bytep)a + (idx + n) * sz,
+	        (array_sz(a) - idx - n) * sz);
 	array_sz(a) -= n;
 }
 
@@ -224,21 +622,17 @@ ARRDEF array_size_t array__index(void *a, const void *userp, size_t sz,
 ARRDEF void *array__upper(void *a, const void *elem, size_t sz,
                           int(*cmp)(const void *, const void*))
 {
-	size_t left = 0, right = array_sz(a), mid = right/2;
-	void *res = NULL;
-	while (left != right)
-	{
-		void *p = (arr_bytep)a+mid*sz;
-		if (cmp(elem, p) < 0)
-		{
-			res = p;
-			right = mid;
-		}
-		else
-			left = mid+1;
-		mid = (right+left)/2;
+	arr_bytep base = a, end = (arr_bytep)a + array_sz(a) * sz;
+	size_t n = array_sz(a);
+	if (n == 0)
+		return NULL;
+	while (n > 1) {
+		const size_t half = n / 2;
+		base = cmp(elem, base + half * sz) < 0 ? base : base + half * sz;
+		n -= half;
 	}
-	return res;
+	base += cmp(elem, base) < 0 ? 0 : sz;
+	return base != end ? base : NULL;
 }
 
 #undef ARRAY_IMPLEMENTATION
@@ -0,0 +1,160 @@
+#ifndef VIOLET_ATOM_H
+#define VIOLET_ATOM_H
+
+/*
+ * String interning.
+ *
+ * An atom table maps every distinct string to a dense u32 id (starting at 1,
+ * 0 is ATOM_NULL), so strings can be stored, hashed & compared as integers.
+ * Interned strings are copied into arena blocks owned by the table & keep
+ * their address until it is destroyed. Looking up an atom's string is an
+ * array index; interning is a hash map lookup by content.
+ */
+
+#ifdef ATOM_STATIC
+#define ATOMDEF static
+#else
+#define ATOMDEF
+#endif
+
+#if defined ATOM_STATIC && !defined ATOM_IMPLEMENTATION
+#define ATOM_IMPLEMENTATION
+#endif
+
+#ifndef ATOM_BLOCK_SZ
+#define ATOM_BLOCK_SZ 4096
+#endif
+
+typedef u32 atom_t;
+
+#define ATOM_NULL 0
+
+typedef struct atom__entry
+{
+	const char *str;
+	u32 len;
+} atom__entry_t;
+
+typedef struct atom_table
+{
+	hashmap(const char*, atom_t) map;
+	array(atom__entry_t) entries; /* indexed by atom - 1 */
+	struct atom__block *blocks;
+	allocator_t *allocator;
+} atom_table_t;
+
+#define atom_table_init(t)          atom_table_init_ex(t, g_allocator)
+#define atom_table_init_ex(t, alc)  atom__table_init(t, alc  MEMCALL_LOCATION)
+#define atom_table_destroy(t)       atom__table_destroy(t  MEMCALL_LOCATION)
+#define atom_count(t)               array_sz((t)->entries)
+
+/* interns str if it isn't already */
+#define atom_intern(t, str)         atom__intern(t, str  MEMCALL_LOCATION)
+
+ATOMDEF void        atom__table_init(atom_table_t *t, allocator_t *a  MEMCALL_ARGS);
+ATOMDEF void        atom__table_destroy(atom_table_t *t  MEMCALL_ARGS);
+ATOMDEF atom_t      atom__intern(atom_table_t *t, const char *str  MEMCALL_ARGS);
+/* ATOM_NULL if str was never interned */
+ATOMDEF atom_t      atom_find(const atom_table_t *t, const char *str);
+ATOMDEF const char *atom_str(const atom_table_t *t, atom_t atom);
+ATOMDEF u32         atom_len(const atom_table_t *t, atom_t atom);
+
+#endif // VIOLET_ATOM_H
+
+#ifdef ATOM_IMPLEMENTATION
+
+typedef struct atom__block
+{
+	struct atom__block *next;
+	u32 used, cap;
+} atom__block_t;
+
+#define atom__block_data(b) ((char*)((b) + 1))
+
+ATOMDEF void atom__table_init(atom_table_t *t, allocator_t *a  MEMCALL_ARGS)
+{
+	hashmap__init(&t->map, sizeof(const char*), _Alignof(const char*),
+	              sizeof(atom_t), _Alignof(atom_t), hashmap_hash_str,
+	              hashmap_eq_str, a  MEMCALL_VARS);
+	t->entries   = array__create(0, sizeof(atom__entry_t), a  MEMCALL_VARS);
+	t->blocks    = NULL;
+	t->allocator = a;
+}
+
+ATOMDEF void atom__table_destroy(atom_table_t *t  MEMCALL_ARGS)
+{
+	hashmap__destroy(&t->map  MEMCALL_VARS);
+	t->allocator->free_(array__get_head(t->entries), t->allocator  MEMCALL_VARS);
+	while (t->blocks) {
+		atom__block_t *next = t->blocks->next;
+		t->allocator->free_(t->blocks, t->allocator  MEMCALL_VARS);
+		t->blocks = next;
+	}
+}
+
+static
+char *atom__store(atom_table_t *t, const char *str, u32 len  MEMCALL_ARGS)
+{
+	atom__block_t *block = t->blocks;
+	char *dst;
+	if (!block || block->cap - block->used < len + 1) {
+		/* long strings get a block of their own, behind the current one */
+		const u32 cap = len + 1 > ATOM_BLOCK_SZ / 4 ? len + 1 : ATOM_BLOCK_SZ;
+		atom__block_t *new_block = t->allocator->malloc_(sizeof(atom__block_t) + cap,
+		                                                 t->allocator  MEMCALL_VARS);
+		error_if(!new_block, "atom: oom");
+		new_block->used = 0;
+		new_block->cap  = cap;
+		if (block && cap != ATOM_BLOCK_SZ) {
+			new_block->next = block->next;
+			block->next = new_block;
+		} else {
+			new_block->next = block;
+			t->blocks = new_block;
+		}
+		block = new_block;
+	}
+	dst = atom__block_data(block) + block->used;
+	memcpy(dst, str, len + 1);
+	block->used += len + 1;
+	return dst;
+}
+
+ATOMDEF atom_t atom__intern(atom_table_t *t, const char *str  MEMCALL_ARGS)
+{
+	b32 inserted;
+	atom_t *atom = hashmap__insert_null(&t->map, &str, &inserted  MEMCALL_VARS);
+	if (inserted) {
+		const u32 len = (u32)strlen(str);
+		atom__entry_t *entry;
+		t->entries = array__append_null(t->entries, sizeof(atom__entry_t)  MEMCALL_VARS);
+		entry = &array_last(t->entries);
+		entry->str = atom__store(t, str, len  MEMCALL_VARS);
+		entry->len = len;
+		/* the map must refer to the interned copy, not the caller's string */
+		*(const char**)((u8*)atom - t->map.val_offset) = entry->str;
+		*atom = array_sz(t->entries);
+	}
+	return *atom;
+}
+
+ATOMDEF atom_t atom_find(const atom_table_t *t, const char *str)
+{
+	const atom_t *atom = hashmap__get(&t->map, &str);
+	return atom ? *atom : ATOM_NULL;
+}
+
+ATOMDEF const char *atom_str(const atom_table_t *t, atom_t atom)
+{
+	assert(atom != ATOM_NULL && atom <= array_sz(t->entries));
+	return t->entries[atom-1].str;
+}
+
+ATOMDEF u32 atom_len(const atom_table_t *t, atom_t atom)
+{
+	assert(atom != ATOM_NULL && atom <= array_sz(t->entries));
+	return t->entries[atom-1].len;
+}
+
+#undef ATOM_IMPLEMENTATION
+#endif // ATOM_IMPLEMENTATION
@@ -100,12 +100,80 @@ typedef union intptr
 static_assert(sizeof(r32) == 4, invalid_floating_point_size);
 static_assert(sizeof(r64) == 8, invalid_double_size);
 
+/* Atomics - pointer-sized integers (size_t) and pointers only */
+
+#ifndef _WIN32
+
+#define vlt_atomic_load(p)            __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define vlt_atomic_store(p, v)        __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define vlt_atomic_add(p, v)          __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL)
+#define vlt_atomic_sub(p, v)          __atomic_fetch_sub(p, v, __ATOMIC_ACQ_REL)
+#define vlt_atomic_swap(p, v)         __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#define vlt_atomic_cas(p, pexp, v)    __atomic_compare_exchange_n(p, pexp, v, \
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define vlt_atomic_load_ptr(p)        vlt_atomic_load(p)
+#define vlt_atomic_store_ptr(p, v)    vlt_atomic_store(p, v)
+#define vlt_atomic_cas_ptr(p, pexp, v) vlt_atomic_cas(p, pexp, v)
+#if defined(__i386__) || defined(__x86_64__)
+#define vlt_cpu_relax()               __builtin_ia32_pause()
+#else
+#define vlt_cpu_relax()               NOOP
+#endif
+
+#else
+
+static inline
+size_t vlt__atomic_load(volatile size_t *p)
+{
+	MemoryBarrier();
+	return *p;
+}
+
+static inline
+b32 vlt__atomic_cas(void *volatile *p, void **expected, void *desired)
+{
+	void *prev = InterlockedCompareExchangePointer(p, desired, *expected);
+	if (prev == *expected)
+		return true;
+	*expected = prev;
+	return false;
+}
+
+#define vlt_atomic_load(p)            vlt__atomic_load(p)
+#define vlt_atomic_store(p, v)        (MemoryBarrier(), *(p) = (v))
+#define vlt_atomic_add(p, v)          InterlockedExchangeAddSizeT(p, v)
+#define vlt_atomic_sub(p, v)          InterlockedExchangeAddSizeT(p, -(SSIZE_T)(v))
+#define vlt_atomic_swap(p, v)         (size_t)InterlockedExchangePointer( \
+                                        (void *volatile *)(p), (void*)(v))
+#define vlt_atomic_cas(p, pexp, v)    vlt__atomic_cas((void *volatile *)(p), \
+                                                      (void**)(pexp), (void*)(v))
+#define vlt_atomic_load_ptr(p)        (MemoryBarrier(), *(p))
+#define vlt_atomic_store_ptr(p, v)    (MemoryBarrier(), *(p) = (v))
+#define vlt_atomic_cas_ptr(p, pexp, v) vlt_atomic_cas(p, pexp, v)
+#define vlt_cpu_relax()               YieldProcessor()
+
+#endif // _WIN32
+
+/* Spin lock - for short, rarely contended critical sections */
+typedef volatile size_t spinlock_t;
+
+#define spinlock_init(l)   vlt_atomic_store(l, 0)
+#define spinlock_unlock(l) vlt_atomic_store(l, 0)
+static inline
+void spinlock_lock(spinlock_t *lock)
+{
+	while (vlt_atomic_swap(lock, 1))
+		while (vlt_atomic_load(lock))
+			vlt_cpu_relax();
+}
+
 /* Initialization */
 
 typedef enum vlt_thread_type
 {
 	VLT_THREAD_MAIN,
 	VLT_THREAD_OTHER,
+	VLT_THREAD_WORKER, /* short-lived - vlt_destroy doesn't log memory usage */
 } vlt_thread_type_e;
 
 void vlt_init(vlt_thread_type_e thread_type);
@@ -161,18 +229,39 @@ void error_catch(const char *msg, void *udata);
  * Defining VLT_TRACK_MEMORY_VERBOSE will log ALL allocations,
  * which is occasionally useful but is quite verbose.
  *
+ * The global tracker is split into VLT_TRACK_MEMORY_SHARDS shards, each
+ * thread allocating from its own shard, so tracking is cheap enough to
+ * leave enabled with many allocating threads.
+ *
  * Defining VLT_ANALYZE_TEMP_MEMORY will help track down inefficient use
  * of the temporary allocator.
+ *
+ * VLT_TEMP_MEMORY_MAX_RETAINED caps the bytes of free temporary memory
+ * pages each heap holds on to (0 = unlimited).
+ *
+ * Temporary memory forks borrow pages from a heap shared by all threads, so
+ * a fork can be created, used & merged on any thread. Defining
+ * VLT_TEMP_MEMORY_SHARED_HEAP makes each thread's temporary allocator use
+ * the shared heap too, instead of hoarding free pages in a heap of its own.
+ *
+ * Defining VLT_TEMP_MEMORY_VMEM backs the temporary allocator with a single
+ * reserved virtual memory range (vmb) instead of separate pages (pgb).
  * */
 
+#ifndef VLT_TEMP_MEMORY_MAX_RETAINED
+#define VLT_TEMP_MEMORY_MAX_RETAINED 0
+#endif
+
 #ifdef VLT_TRACK_MEMORY
 #define MEMCALL_LOCATION , LOCATION
 #define MEMCALL_ARGS , const char *loc
 #define MEMCALL_VARS , loc
+#define MEMCALL_LOC  loc
 #else
 #define MEMCALL_LOCATION
 #define MEMCALL_ARGS
 #define MEMCALL_VARS
+#define MEMCALL_LOC  "unknown location"
 #endif
 
 typedef struct allocator allocator_t;
@@ -182,6 +271,9 @@ typedef struct allocator
 	void* (*calloc_)(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS);
 	void* (*realloc_)(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS);
 	void  (*free_)(void *ptr, allocator_t *a  MEMCALL_ARGS);
+	void* (*malloc_aligned_)(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS);
+	void* (*realloc_aligned_)(void *ptr, size_t size, size_t alignment,
+	                          allocator_t *a  MEMCALL_ARGS);
 	void *udata;
 } allocator_t;
 
@@ -191,6 +283,8 @@ typedef struct allocator
 		.calloc_  = name##_calloc, \
 		.realloc_ = name##_realloc, \
 		.free_    = name##_free, \
+		.malloc_aligned_  = name##_malloc_aligned, \
+		.realloc_aligned_ = name##_realloc_aligned, \
 		.udata    = udata_, \
 	}
 
@@ -199,6 +293,12 @@ typedef struct allocator
 #define arealloc(p, sz, a)      (a)->realloc_(p, sz, a  MEMCALL_LOCATION)
 #define afree(p, a)             (a)->free_(p, a  MEMCALL_LOCATION)
 
+/* Alignment must be a power of 2. Memory allocated with an alignment is
+ * freed with afree like any other - but arealloc only guarantees the
+ * default alignment, so use arealloc_aligned to keep it. */
+#define amalloc_aligned(sz, align, a)     (a)->malloc_aligned_(sz, align, a  MEMCALL_LOCATION)
+#define arealloc_aligned(p, sz, align, a) (a)->realloc_aligned_(p, sz, align, a  MEMCALL_LOCATION)
+
 /* Default global allocator */
 extern allocator_t *g_allocator;
 
@@ -210,44 +310,86 @@ void *default_malloc(size_t size, allocator_t *a  MEMCALL_ARGS);
 void *default_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS);
 void *default_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS);
 void  default_free(void *ptr, allocator_t *a  MEMCALL_ARGS);
+void *default_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS);
+void *default_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                              allocator_t *a  MEMCALL_ARGS);
 
 /* Paged bump memory allocator */
 #include "violet/pgb.h"
 
+/* Virtual memory bump allocator */
+#include "violet/vmb.h"
+
+#ifndef VLT_TEMP_MEMORY_VMEM
 typedef pgb_watermark_t temp_memory_mark_t;
 #define     temp_memory_save(alloc)    pgb_save((alloc)->udata)
 #define     temp_memory_restore(mark)  pgb_restore(mark)
 allocator_t temp_memory_fork_(pgb_t *pgb);
 #define     temp_memory_fork()         temp_memory_fork_(&(pgb_t){0})
+#else
+typedef vmb_watermark_t temp_memory_mark_t;
+#define     temp_memory_save(alloc)    vmb_save((alloc)->udata)
+#define     temp_memory_restore(mark)  vmb_restore(mark)
+allocator_t temp_memory_fork_(vmb_t *vmb);
+#define     temp_memory_fork()         temp_memory_fork_(&(vmb_t){0})
+#endif
 void        temp_memory_merge(allocator_t *fork);
 
+/* Size-class pool allocator */
+#include "violet/pool.h"
+
 /* Tracking allocator */
 typedef struct alloc_node
 {
 	struct alloc_node *prev, *next;
+	struct alloc_tracker *tracker;
 	size_t sz, generation;
+	size_t offset; /* from the start of the block, for aligned allocations */
 	const char *location;
+	size_t padding_; /* keep the user memory 16-byte aligned */
 } alloc_node_t;
 
+/* Aggregated statistics for every allocation made from the same LOCATION.
+ * Sites are keyed by the location pointer, so the same callsite compiled into
+ * multiple translation units may show up more than once. */
+typedef struct alloc_site
+{
+	const char *location;
+	size_t live_count, live_bytes, peak_bytes;
+	size_t total_count, total_bytes;
+} alloc_site_t;
+
 typedef struct alloc_tracker
 {
 	alloc_node_t *head, *tail;
 	size_t generation;
 	size_t current_bytes, peak_bytes, total_bytes;
 	size_t total_chunks;
+	alloc_site_t *sites;
+	size_t site_cap, site_cnt;
 } alloc_tracker_t;
 
-void alloc_tracker_advance_gen(alloc_tracker_t *tracker);
-void alloc_tracker_log_usage(alloc_tracker_t *tracker, b32 warn_active_allocations);
-void alloc_tracker_log_current_gen(alloc_tracker_t *tracker, size_t gen);
+void   alloc_tracker_destroy(alloc_tracker_t *tracker);
+void   alloc_tracker_advance_gen(alloc_tracker_t *tracker);
+void   alloc_tracker_log_usage(alloc_tracker_t *tracker, b32 warn_active_allocations);
+void   alloc_tracker_log_current_gen(alloc_tracker_t *tracker, size_t gen);
+/* Fills sites with (at most n) callsites with the most live bytes,
+ * in descending order - returns the number of sites written. */
+size_t alloc_tracker_top_sites(const alloc_tracker_t *tracker,
+                               alloc_site_t *sites, size_t n);
+void   alloc_tracker_log_top_sites(const alloc_tracker_t *tracker, size_t n);
 
 void *tracked_malloc(size_t size, allocator_t *a  MEMCALL_ARGS);
 void *tracked_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS);
 void *tracked_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS);
 void  tracked_free(void *ptr, allocator_t *a  MEMCALL_ARGS);
+void *tracked_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS);
+void *tracked_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                              allocator_t *a  MEMCALL_ARGS);
 
 void vlt_mem_advance_gen(void);
 void vlt_mem_log_usage(void);
+void vlt_mem_log_top_sites(size_t n);
 
 #ifdef VLT_TRACK_MEMORY
 
@@ -273,9 +415,49 @@ static inline void  std_free(void *ptr) { return free(ptr); }
 
 /* Hash */
 
+/* hash64n reads its input a word at a time, with 4 independent lanes for
+ * inputs longer than HASH_SHORT_MAX bytes. hash & hashn are its low bits. */
+u64 hash64(const char *str);
+u64 hash64n(const void *data, size_t n);
 u32 hash(const char *str);
 u32 hashn(const char *str, u32 n);
 
+/* Hash a string literal - equal to hash64(s), but folded to a constant by
+ * any optimizing build. Literals longer than HASH_SHORT_MAX bytes are hashed
+ * at runtime. */
+#define hash64_lit(s) (  sizeof(s) - 1 <= HASH_SHORT_MAX \
+                       ? hash__fmix(hash__short_lit(s)) \
+                       : hash64n(s, sizeof(s) - 1))
+#define hash_lit(s)   ((u32)hash64_lit(s))
+
+#define HASH_SHORT_MAX 64
+#define HASH__SEED     0x9e3779b97f4a7c15ull
+#define HASH__K0       0xc2b2ae3d27d4eb4full
+#define HASH__K1       0x165667b19e3779f9ull
+#define HASH__K2       0xff51afd7ed558ccdull
+#define HASH__K3       0xc4ceb9fe1a85ec53ull
+
+#define hash__fmix_(h, k)  (((h) ^ ((h) >> 33)) * (k))
+#define hash__fmix(h)      (  hash__fmix_(hash__fmix_((u64)(h), HASH__K2), HASH__K3) \
+                            ^ (hash__fmix_(hash__fmix_((u64)(h), HASH__K2), HASH__K3) >> 33))
+
+/* One step of the short path per 8 byte (zero padded, little endian) word -
+ * past the end of the literal the step is (h ^ 0) * 1. */
+#define hash__lit_byte(s, i) \
+	((u64)(sizeof(s) - 1 > (i) ? (u8)(s)[(i) % sizeof(s)] : 0) << (8 * ((i) % 8)))
+#define hash__lit_word(s, w) \
+	(  hash__lit_byte(s, 8*(w)+0) | hash__lit_byte(s, 8*(w)+1) \
+	 | hash__lit_byte(s, 8*(w)+2) | hash__lit_byte(s, 8*(w)+3) \
+	 | hash__lit_byte(s, 8*(w)+4) | hash__lit_byte(s, 8*(w)+5) \
+	 | hash__lit_byte(s, 8*(w)+6) | hash__lit_byte(s, 8*(w)+7))
+#define hash__lit_step(h, s, w) \
+	(((h) ^ hash__lit_word(s, w)) * (sizeof(s) - 1 > 8 * (w) ? HASH__K1 : 1))
+#define hash__short_lit(s) \
+	hash__lit_step(hash__lit_step(hash__lit_step(hash__lit_step( \
+	hash__lit_step(hash__lit_step(hash__lit_step(hash__lit_step( \
+		HASH__SEED ^ ((u64)(sizeof(s) - 1) * HASH__K0), \
+	s, 0), s, 1), s, 2), s, 3), s, 4), s, 5), s, 6), s, 7)
+
 /* Utility */
 
 #define memswp(a, b, type) \
@@ -444,54 +626,159 @@ void error_catch(const char *msg, void *udata)
 
 #ifdef VLT_TRACK_MEMORY
 
-#include <SDL_thread.h>
+#ifndef VLT_TRACK_MEMORY_SHARDS
+#define VLT_TRACK_MEMORY_SHARDS 16
+#endif
 
-typedef struct global_alloc_tracker
+/* Each shard's list is only touched by the threads bound to it, except when
+ * memory is freed on a different thread than it was allocated or the shards
+ * are merged for logging, so its lock is almost never contended. */
+typedef struct global_alloc_shard
 {
-	SDL_mutex *mutex;
 	alloc_tracker_t tracker;
+	spinlock_t lock;
+} global_alloc_shard_t;
+
+typedef struct global_alloc_tracker
+{
+	global_alloc_shard_t shards[VLT_TRACK_MEMORY_SHARDS];
+	volatile size_t next_shard;
+	volatile size_t current_bytes, peak_bytes, total_bytes;
+	volatile size_t total_chunks;
 } global_alloc_tracker_t;
 
+static thread_local global_alloc_shard_t *g_alloc_shard = NULL;
+
+static
+global_alloc_shard_t *global_alloc_tracker__thread_shard(global_alloc_tracker_t *global_tracker)
+{
+	if (!g_alloc_shard) {
+		const size_t idx = vlt_atomic_add(&global_tracker->next_shard, 1);
+		g_alloc_shard = &global_tracker->shards[idx % VLT_TRACK_MEMORY_SHARDS];
+	}
+	return g_alloc_shard;
+}
+
+static
+global_alloc_shard_t *global_alloc_tracker__owner_shard(const void *ptr)
+{
+	/* tracker is the first member of the shard */
+	return (global_alloc_shard_t*)(((const alloc_node_t*)ptr - 1)->tracker);
+}
+
+static
+void global_alloc_tracker__record(global_alloc_tracker_t *global_tracker,
+                                  size_t old_sz, size_t new_sz)
+{
+	size_t current, peak;
+	if (new_sz) {
+		vlt_atomic_add(&global_tracker->total_bytes, new_sz);
+		vlt_atomic_add(&global_tracker->total_chunks, 1);
+	}
+	current = vlt_atomic_add(&global_tracker->current_bytes, new_sz - old_sz)
+	        + new_sz - old_sz;
+	peak = vlt_atomic_load(&global_tracker->peak_bytes);
+	while (peak < current && !vlt_atomic_cas(&global_tracker->peak_bytes, &peak, current))
+		;
+}
+
 void *global_tracked_malloc(size_t size, allocator_t *a  MEMCALL_ARGS)
 {
 	global_alloc_tracker_t *global_tracker = a->udata;
-	allocator_t a_ = allocator_create(tracked, &global_tracker->tracker);
+	global_alloc_shard_t *shard = global_alloc_tracker__thread_shard(global_tracker);
+	allocator_t a_ = allocator_create(tracked, &shard->tracker);
 	void *p;
-	SDL_LockMutex(global_tracker->mutex);
+	spinlock_lock(&shard->lock);
 	p = tracked_malloc(size, &a_  MEMCALL_VARS);
-	SDL_UnlockMutex(global_tracker->mutex);
+	spinlock_unlock(&shard->lock);
+	global_alloc_tracker__record(global_tracker, 0, size);
 	return p;
 }
 
 void *global_tracked_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS)
 {
 	global_alloc_tracker_t *global_tracker = a->udata;
-	allocator_t a_ = allocator_create(tracked, &global_tracker->tracker);
+	global_alloc_shard_t *shard = global_alloc_tracker__thread_shard(global_tracker);
+	allocator_t a_ = allocator_create(tracked, &shard->tracker);
 	void *p;
-	SDL_LockMutex(global_tracker->mutex);
+	spinlock_lock(&shard->lock);
 	p = tracked_calloc(nmemb, size, &a_  MEMCALL_VARS);
-	SDL_UnlockMutex(global_tracker->mutex);
+	spinlock_unlock(&shard->lock);
+	global_alloc_tracker__record(global_tracker, 0, nmemb * size);
 	return p;
 }
 
 void *global_tracked_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS)
 {
 	global_alloc_tracker_t *global_tracker = a->udata;
-	allocator_t a_ = allocator_create(tracked, &global_tracker->tracker);
+	global_alloc_shard_t *shard;
+	allocator_t a_;
+	size_t old_sz;
 	void *p;
-	SDL_LockMutex(global_tracker->mutex);
+	if (!ptr)
+		return global_tracked_malloc(size, a  MEMCALL_VARS);
+	/* the node stays in the list of the shard that allocated it */
+	shard = global_alloc_tracker__owner_shard(ptr);
+	a_ = allocator_create(tracked, &shard->tracker);
+	spinlock_lock(&shard->lock);
+	old_sz = ((alloc_node_t*)ptr - 1)->sz;
 	p = tracked_realloc(ptr, size, &a_  MEMCALL_VARS);
-	SDL_UnlockMutex(global_tracker->mutex);
+	spinlock_unlock(&shard->lock);
+	/* a failed realloc leaves the old block live at old_sz */
+	if (p || !size)
+		global_alloc_tracker__record(global_tracker, old_sz, size);
 	return p;
 }
 
 void global_tracked_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
 {
 	global_alloc_tracker_t *global_tracker = a->udata;
-	allocator_t a_ = allocator_create(tracked, &global_tracker->tracker);
-	SDL_LockMutex(global_tracker->mutex);
+	global_alloc_shard_t *shard;
+	allocator_t a_;
+	size_t old_sz;
+	if (!ptr)
+		return;
+	shard = global_alloc_tracker__owner_shard(ptr);
+	a_ = allocator_create(tracked, &shard->tracker);
+	spinlock_lock(&shard->lock);
+	old_sz = ((alloc_node_t*)ptr - 1)->sz;
 	tracked_free(ptr, &a_  MEMCALL_VARS);
-	SDL_UnlockMutex(global_tracker->mutex);
+	spinlock_unlock(&shard->lock);
+	global_alloc_tracker__record(global_tracker, old_sz, 0);
+}
+
+void *global_tracked_malloc_aligned(size_t size, size_t alignment,
+                                    allocator_t *a  MEMCALL_ARGS)
+{
+	global_alloc_tracker_t *global_tracker = a->udata;
+	global_alloc_shard_t *shard = global_alloc_tracker__thread_shard(global_tracker);
+	allocator_t a_ = allocator_create(tracked, &shard->tracker);
+	void *p;
+	spinlock_lock(&shard->lock);
+	p = tracked_malloc_aligned(size, alignment, &a_  MEMCALL_VARS);
+	spinlock_unlock(&shard->lock);
+	global_alloc_tracker__record(global_tracker, 0, size);
+	return p;
+}
+
+void *global_tracked_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                                     allocator_t *a  MEMCALL_ARGS)
+{
+	void *p;
+	if (!ptr)
+		return global_tracked_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	if (!size) {
+		global_tracked_free(ptr, a  MEMCALL_VARS);
+		return NULL;
+	}
+	/* the new block may belong to a different shard than the old one */
+	p = global_tracked_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	if (p) {
+		const size_t old_sz = ((alloc_node_t*)ptr - 1)->sz;
+		memcpy(p, ptr, old_sz < size ? old_sz : size);
+		global_tracked_free(ptr, a  MEMCALL_VARS);
+	}
+	return p;
 }
 
 
@@ -511,16 +798,25 @@ void log_alloc(const char *prefix, size_t sz  MEMCALL_ARGS)
 #define PGB_IMPLEMENTATION
 #include "violet/pgb.h"
 
-thread_local pgb_t g_temp_allocator_pgb    = {0};
+#define POOL_IMPLEMENTATION
+#include "violet/pool.h"
+
+#define VMB_IMPLEMENTATION
+#include "violet/vmb.h"
+
 thread_local allocator_t g_temp_allocator_ = {0};
 thread_local allocator_t *g_temp_allocator = NULL;
 
-thread_local pgb_heap_t g_temp_memory_heap = { .first_page = NULL };
+#ifndef VLT_TEMP_MEMORY_VMEM
+
+thread_local pgb_t g_temp_allocator_pgb    = {0};
+thread_local pgb_heap_t g_temp_memory_heap = {0};
+pgb_heap_t g_temp_memory_shared_heap       = { .concurrent = true };
 
 allocator_t temp_memory_fork_(pgb_t *pgb)
 {
 	allocator_t allocator = allocator_create(pgb, pgb);
-	pgb_init(allocator.udata, &g_temp_memory_heap);
+	pgb_init(allocator.udata, &g_temp_memory_shared_heap);
 	return allocator;
 }
 
@@ -530,9 +826,87 @@ void temp_memory_merge(allocator_t *fork)
 	pgb_destroy(fork->udata);
 }
 
+static
+void temp_memory__init(vlt_thread_type_e thread_type)
+{
+	g_temp_allocator_ = allocator_create(pgb, &g_temp_allocator_pgb);
+#ifdef VLT_TEMP_MEMORY_SHARED_HEAP
+	pgb_init(&g_temp_allocator_pgb, &g_temp_memory_shared_heap);
+#else
+	pgb_init(&g_temp_allocator_pgb, &g_temp_memory_heap);
+	pgb_heap_set_max_retained(&g_temp_memory_heap, VLT_TEMP_MEMORY_MAX_RETAINED);
+#endif
+	if (thread_type == VLT_THREAD_MAIN)
+		pgb_heap_set_max_retained(&g_temp_memory_shared_heap,
+		                          VLT_TEMP_MEMORY_MAX_RETAINED);
+}
+
+static
+void temp_memory__destroy(vlt_thread_type_e thread_type)
+{
+	pgb_destroy(&g_temp_allocator_pgb);
+	pgb_heap_destroy(&g_temp_memory_heap);
+	if (thread_type == VLT_THREAD_MAIN)
+		pgb_heap_destroy(&g_temp_memory_shared_heap);
+}
+
+static
+void temp_memory__stats(size_t *bytes_used, size_t *pages_used,
+                        size_t *bytes_available, size_t *pages_available)
+{
+	pgb_stats(g_temp_allocator->udata, bytes_used, pages_used,
+	          bytes_available, pages_available);
+}
+
+#else
+
+thread_local vmb_t g_temp_allocator_vmb = {0};
+
+allocator_t temp_memory_fork_(vmb_t *vmb)
+{
+	allocator_t allocator = allocator_create(vmb, vmb);
+	vmb_init(allocator.udata, VMB_RESERVE_SIZE);
+	return allocator;
+}
+
+void temp_memory_merge(allocator_t *fork)
+{
+	assert(fork != g_temp_allocator);
+	vmb_destroy(fork->udata);
+}
+
+static
+void temp_memory__init(vlt_thread_type_e thread_type)
+{
+	g_temp_allocator_ = allocator_create(vmb, &g_temp_allocator_vmb);
+	vmb_init(&g_temp_allocator_vmb, VMB_RESERVE_SIZE);
+}
+
+static
+void temp_memory__destroy(vlt_thread_type_e thread_type)
+{
+	vmb_destroy(&g_temp_allocator_vmb);
+}
+
+/* reports committed memory in VMB_COMMIT_SIZE 'pages' */
+static
+void temp_memory__stats(size_t *bytes_used, size_t *pages_used,
+                        size_t *bytes_available, size_t *pages_available)
+{
+	size_t bytes_committed, bytes_reserved;
+	vmb_stats(g_temp_allocator->udata, bytes_used, &bytes_committed, &bytes_reserved);
+	*pages_used      = (*bytes_used + VMB_COMMIT_SIZE - 1) / VMB_COMMIT_SIZE;
+	*bytes_available = bytes_committed - *bytes_used;
+	*pages_available = bytes_committed / VMB_COMMIT_SIZE - *pages_used;
+}
+
+#endif // VLT_TEMP_MEMORY_VMEM
+
 
 /* Default allocator */
 
+#ifndef _WIN32
+
 void *default_malloc(size_t size, allocator_t *a  MEMCALL_ARGS)
 {
 	return std_malloc(size);
@@ -553,37 +927,218 @@ void default_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
 	std_free(ptr);
 }
 
+void *default_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS)
+{
+	void *ptr;
+	if (alignment < sizeof(void*))
+		alignment = sizeof(void*);
+	return posix_memalign(&ptr, alignment, size) == 0 ? ptr : NULL;
+}
+
+void *default_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                              allocator_t *a  MEMCALL_ARGS)
+{
+	void *new_ptr;
+	if (!ptr)
+		return size ? default_malloc_aligned(size, alignment, a  MEMCALL_VARS) : NULL;
+	if (!size) {
+		std_free(ptr);
+		return NULL;
+	}
+	/* realloc usually keeps the alignment - only move the block when it doesn't */
+	new_ptr = std_realloc(ptr, size);
+	if (!new_ptr || ((uintptr_t)new_ptr & (alignment - 1)) == 0)
+		return new_ptr;
+	ptr = default_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	if (ptr)
+		memcpy(ptr, new_ptr, size);
+	std_free(new_ptr);
+	return ptr;
+}
+
+#else
+
+/* The CRT can neither free() nor realloc() over-aligned memory, so every block
+ * from the default allocator records where it starts & how it is aligned. */
+#define DEFAULT__MIN_ALIGNMENT 16
+
+typedef struct default__header
+{
+	u8 *block;
+	size_t alignment;
+} default__header_t;
+
+static
+u8 *default__place(u8 *block, size_t alignment)
+{
+	const uintptr_t p = (uintptr_t)block + sizeof(default__header_t) + alignment - 1;
+	return (u8*)(p & ~(uintptr_t)(alignment - 1));
+}
+
+void *default_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS)
+{
+	default__header_t *header;
+	u8 *block, *ptr;
+	if (alignment < DEFAULT__MIN_ALIGNMENT)
+		alignment = DEFAULT__MIN_ALIGNMENT;
+	block = std_malloc(sizeof(default__header_t) + alignment - 1 + size);
+	if (!block)
+		return NULL;
+	ptr = default__place(block, alignment);
+	header = (default__header_t*)ptr - 1;
+	header->block = block;
+	header->alignment = alignment;
+	return ptr;
+}
+
+void *default_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                              allocator_t *a  MEMCALL_ARGS)
+{
+	default__header_t *header;
+	u8 *block, *new_ptr;
+	size_t offset;
+	if (!ptr)
+		return size ? default_malloc_aligned(size, alignment, a  MEMCALL_VARS) : NULL;
+	if (!size) {
+		default_free(ptr, a  MEMCALL_VARS);
+		return NULL;
+	}
+	header = (default__header_t*)ptr - 1;
+	if (alignment < header->alignment)
+		alignment = header->alignment;
+	offset = (u8*)ptr - header->block;
+	block = std_realloc(header->block, sizeof(default__header_t) + alignment - 1 + size);
+	if (!block)
+		return NULL;
+	new_ptr = default__place(block, alignment);
+	if (new_ptr != block + offset)
+		memmove(new_ptr, block + offset, size);
+	header = (default__header_t*)new_ptr - 1;
+	header->block = block;
+	header->alignment = alignment;
+	return new_ptr;
+}
+
+void *default_malloc(size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	return default_malloc_aligned(size, DEFAULT__MIN_ALIGNMENT, a  MEMCALL_VARS);
+}
+
+void *default_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	void *ptr = default_malloc_aligned(nmemb * size, DEFAULT__MIN_ALIGNMENT, a  MEMCALL_VARS);
+	if (ptr)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+void *default_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	return default_realloc_aligned(ptr, size, DEFAULT__MIN_ALIGNMENT, a  MEMCALL_VARS);
+}
+
+void default_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
+{
+	if (ptr)
+		std_free(((default__header_t*)ptr - 1)->block);
+}
+
+#endif // _WIN32
+
 /* Tracking allocator */
 
+#define ALLOC_TRACKER__SITE_MIN_CAP 64
+
+static
+size_t alloc_tracker__site_idx(const char *location, size_t cap)
+{
+	const u64 h = (u64)(uintptr_t)location * 0x9e3779b97f4a7c15ull;
+	return (size_t)(h >> 32) & (cap - 1);
+}
+
+static
+alloc_site_t *alloc_tracker__site_slot(alloc_site_t *sites, size_t cap,
+                                       const char *location)
+{
+	size_t i = alloc_tracker__site_idx(location, cap);
+	while (sites[i].location && sites[i].location != location)
+		i = (i + 1) & (cap - 1);
+	return &sites[i];
+}
+
 static
-void alloc_tracker__record_alloc(alloc_tracker_t *tracker, size_t sz)
+void alloc_tracker__grow_sites(alloc_tracker_t *tracker)
 {
+	const size_t cap = tracker->site_cap ? tracker->site_cap * 2
+	                                     : ALLOC_TRACKER__SITE_MIN_CAP;
+	alloc_site_t *sites = std_calloc(cap, sizeof(alloc_site_t));
+	error_if(!sites, "alloc_tracker__grow_sites: oom");
+	for (size_t i = 0; i < tracker->site_cap; ++i)
+		if (tracker->sites[i].location)
+			*alloc_tracker__site_slot(sites, cap, tracker->sites[i].location)
+				= tracker->sites[i];
+	std_free(tracker->sites);
+	tracker->sites = sites;
+	tracker->site_cap = cap;
+}
+
+static
+alloc_site_t *alloc_tracker__site(alloc_tracker_t *tracker, const char *location)
+{
+	alloc_site_t *site;
+	if ((tracker->site_cnt + 1) * 4 > tracker->site_cap * 3)
+		alloc_tracker__grow_sites(tracker);
+	site = alloc_tracker__site_slot(tracker->sites, tracker->site_cap, location);
+	if (!site->location) {
+		site->location = location;
+		++tracker->site_cnt;
+	}
+	return site;
+}
+
+static
+void alloc_tracker__record_alloc(alloc_tracker_t *tracker, size_t sz,
+                                 const char *location)
+{
+	alloc_site_t *site = alloc_tracker__site(tracker, location);
 	tracker->current_bytes += sz;
 	if (tracker->peak_bytes < tracker->current_bytes)
 		tracker->peak_bytes = tracker->current_bytes;
 	tracker->total_bytes += sz;
 	++tracker->total_chunks;
+	++site->live_count;
+	site->live_bytes += sz;
+	if (site->peak_bytes < site->live_bytes)
+		site->peak_bytes = site->live_bytes;
+	++site->total_count;
+	site->total_bytes += sz;
 }
 
 static
-void alloc_tracker__record_free(alloc_tracker_t *tracker, size_t sz)
+void alloc_tracker__record_free(alloc_tracker_t *tracker, size_t sz,
+                                const char *location)
 {
+	alloc_site_t *site = alloc_tracker__site(tracker, location);
 	tracker->current_bytes -= sz;
+	--site->live_count;
+	site->live_bytes -= sz;
 }
 
 static
 void alloc_tracker__append_node(alloc_tracker_t *tracker,
                                 alloc_node_t *node, size_t sz  MEMCALL_ARGS)
 {
+	node->tracker = tracker;
 	node->sz = sz;
 	node->generation = tracker->generation;
+	node->offset = 0;
 	node->next = NULL;
 #ifdef VLT_TRACK_MEMORY
 	node->location = loc;
 #else
 	node->location = "(unknown)";
 #endif
-	alloc_tracker__record_alloc(tracker, sz);
+	alloc_tracker__record_alloc(tracker, sz, node->location);
 	if (tracker->tail) {
 		tracker->tail->next = node;
 		node->prev = tracker->tail;
@@ -595,6 +1150,14 @@ void alloc_tracker__append_node(alloc_tracker_t *tracker,
 	}
 }
 
+void alloc_tracker_destroy(alloc_tracker_t *tracker)
+{
+	std_free(tracker->sites);
+	tracker->sites = NULL;
+	tracker->site_cap = 0;
+	tracker->site_cnt = 0;
+}
+
 void alloc_tracker_advance_gen(alloc_tracker_t *tracker)
 {
 	++tracker->generation;
@@ -602,25 +1165,37 @@ void alloc_tracker_advance_gen(alloc_tracker_t *tracker)
 		log_warn("generation wrap-around");
 }
 
-void alloc_tracker_log_usage(alloc_tracker_t *tracker, b32 warn_active_allocations)
+static
+void alloc_tracker__log_active_allocations(const alloc_tracker_t *tracker)
 {
-	log_info("***HEAP***");
+	const alloc_node_t *node = tracker->head;
+	while (node) {
+		log_warn("%p: %6lu bytes still active from %s @ gen %lu!",
+		         node + 1, node->sz, node->location, node->generation);
+		node = node->next;
+	}
+}
 
-	if (warn_active_allocations) {
-		alloc_node_t *node = tracker->head;
-		while (node) {
-			log_warn("%p: %6lu bytes still active from %s @ gen %lu!",
-			         node + 1, node->sz, node->location, node->generation);
-			node = node->next;
-		}
+static
+void alloc_tracker__log_totals(size_t current_bytes, size_t peak_bytes,
+                               size_t total_bytes, size_t total_chunks,
+                               b32 warn_active_allocations)
+{
+	if (warn_active_allocations && current_bytes != 0)
+		log_warn("exit:  %10lu bytes still allocated!", current_bytes);
 
-		if (tracker->current_bytes != 0)
-			log_warn("exit:  %10lu bytes still allocated!", tracker->current_bytes);
-	}
+	log_info("peak:  %10lu bytes", peak_bytes);
+ 	log_info("total: %10lu bytes in %lu chunks", total_bytes, total_chunks);
+}
 
-	log_info("peak:  %10lu bytes", tracker->peak_bytes);
- 	log_info("total: %10lu bytes in %lu chunks",
-	         tracker->total_bytes, tracker->total_chunks);
+void alloc_tracker_log_usage(alloc_tracker_t *tracker, b32 warn_active_allocations)
+{
+	log_info("***HEAP***");
+	if (warn_active_allocations)
+		alloc_tracker__log_active_allocations(tracker);
+	alloc_tracker__log_totals(tracker->current_bytes, tracker->peak_bytes,
+	                          tracker->total_bytes, tracker->total_chunks,
+	                          warn_active_allocations);
 }
 
 void alloc_tracker_log_current_gen(alloc_tracker_t *tracker, size_t gen)
@@ -634,9 +1209,58 @@ void alloc_tracker_log_current_gen(alloc_tracker_t *tracker, size_t gen)
  	}
 }
 
+static
+size_t alloc_tracker__top_sites(const alloc_site_t *sites, size_t cap,
+                                alloc_site_t *top, size_t top_cnt, size_t n)
+{
+	if (!n)
+		return 0;
+	for (size_t i = 0; i < cap; ++i) {
+		size_t j;
+		if (!sites[i].location)
+			continue;
+		if (top_cnt == n && sites[i].live_bytes <= top[n-1].live_bytes)
+			continue;
+		j = top_cnt < n ? top_cnt++ : n - 1;
+		for (; j > 0 && top[j-1].live_bytes < sites[i].live_bytes; --j)
+			top[j] = top[j-1];
+		top[j] = sites[i];
+	}
+	return top_cnt;
+}
+
+size_t alloc_tracker_top_sites(const alloc_tracker_t *tracker,
+                               alloc_site_t *sites, size_t n)
+{
+	return alloc_tracker__top_sites(tracker->sites, tracker->site_cap, sites, 0, n);
+}
+
+static
+void alloc_tracker__log_sites(const alloc_site_t *sites, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		log_info("%10lu bytes in %6lu chunks (peak %10lu, total %10lu in %lu) from %s",
+		         sites[i].live_bytes, sites[i].live_count, sites[i].peak_bytes,
+		         sites[i].total_bytes, sites[i].total_count, sites[i].location);
+}
+
+void alloc_tracker_log_top_sites(const alloc_tracker_t *tracker, size_t n)
+{
+	alloc_site_t *sites = std_malloc(n * sizeof(alloc_site_t));
+	if (n && !sites) {
+		log_error("alloc_tracker: oom logging top %lu allocation sites", n);
+		return;
+	}
+	log_info("top %lu allocation sites:", n);
+	alloc_tracker__log_sites(sites, alloc_tracker_top_sites(tracker, sites, n));
+	std_free(sites);
+}
+
 void *tracked_malloc(size_t sz, allocator_t *a  MEMCALL_ARGS)
 {
 	alloc_node_t *node = std_malloc(sizeof(alloc_node_t) + sz);
+	if (!node)
+		return NULL;
 	alloc_tracker__append_node(a->udata, node, sz  MEMCALL_VARS);
 	log_alloc("std", sz  MEMCALL_VARS);
 	return node + 1;
@@ -655,11 +1279,19 @@ void *tracked_realloc(void *ptr, size_t sz, allocator_t *a  MEMCALL_ARGS)
 	alloc_tracker_t *tracker = a->udata;
 	if (ptr) {
 		alloc_node_t *old_node = (alloc_node_t*)ptr - 1;
-		alloc_tracker__record_free(tracker, old_node->sz);
-		if (sz) {
+		if (sz && old_node->offset) {
+			/* the block doesn't start at the node - just move it */
+			void *new_ptr = tracked_malloc(sz, a  MEMCALL_VARS);
+			if (!new_ptr)
+				return NULL; /* the old block is untouched */
+			memcpy(new_ptr, ptr, old_node->sz < sz ? old_node->sz : sz);
+			tracked_free(ptr, a  MEMCALL_VARS);
+			return new_ptr;
+		} else if (sz) {
 			alloc_node_t *node = std_realloc(old_node, sizeof(alloc_node_t) + sz);
-			alloc_tracker__record_alloc(tracker, sz);
-			log_alloc("std", sz  MEMCALL_VARS);
+			if (!node)
+				return NULL; /* the old block is untouched */
+			alloc_tracker__record_free(tracker, node->sz, node->location);
 			node->sz = sz;
 			node->generation = tracker->generation;
 #ifdef VLT_TRACK_MEMORY
@@ -667,6 +1299,8 @@ void *tracked_realloc(void *ptr, size_t sz, allocator_t *a  MEMCALL_ARGS)
 #else
 			node->location = "(unknown)";
 #endif
+			alloc_tracker__record_alloc(tracker, sz, node->location);
+			log_alloc("std", sz  MEMCALL_VARS);
 			if (node != old_node) {
 				if (node->prev)
 					node->prev->next = node;
@@ -702,18 +1336,57 @@ void tracked_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
 			tracker->head = node->next;
 		if (tracker->tail == node)
 			tracker->tail = node->prev;
-		alloc_tracker__record_free(a->udata, node->sz);
-		std_free(node);
+		alloc_tracker__record_free(tracker, node->sz, node->location);
+		std_free((u8*)node - node->offset);
 	}
 }
 
+void *tracked_malloc_aligned(size_t sz, size_t alignment, allocator_t *a  MEMCALL_ARGS)
+{
+	alloc_node_t *node;
+	u8 *block;
+	uintptr_t p;
+	if (alignment <= 16)
+		return tracked_malloc(sz, a  MEMCALL_VARS);
+	block = std_malloc(sizeof(alloc_node_t) + alignment - 1 + sz);
+	if (!block)
+		return NULL;
+	p = (uintptr_t)block + sizeof(alloc_node_t) + alignment - 1;
+	node = (alloc_node_t*)(p & ~(uintptr_t)(alignment - 1)) - 1;
+	alloc_tracker__append_node(a->udata, node, sz  MEMCALL_VARS);
+	node->offset = (u8*)node - block;
+	log_alloc("std", sz  MEMCALL_VARS);
+	return node + 1;
+}
+
+void *tracked_realloc_aligned(void *ptr, size_t sz, size_t alignment,
+                              allocator_t *a  MEMCALL_ARGS)
+{
+	void *new_ptr;
+	size_t old_sz;
+	if (!ptr)
+		return sz ? tracked_malloc_aligned(sz, alignment, a  MEMCALL_VARS) : NULL;
+	if (alignment <= 16 || !sz)
+		return tracked_realloc(ptr, sz, a  MEMCALL_VARS);
+	old_sz = ((alloc_node_t*)ptr - 1)->sz;
+	new_ptr = tracked_malloc_aligned(sz, alignment, a  MEMCALL_VARS);
+	if (!new_ptr)
+		return NULL;
+	memcpy(new_ptr, ptr, old_sz < sz ? old_sz : sz);
+	tracked_free(ptr, a  MEMCALL_VARS);
+	return new_ptr;
+}
+
 void vlt_mem_advance_gen(void)
 {
 #ifdef VLT_TRACK_MEMORY
 	global_alloc_tracker_t *global_tracker = g_allocator->udata;
-	SDL_LockMutex(global_tracker->mutex);
-	alloc_tracker_advance_gen(&global_tracker->tracker);
-	SDL_UnlockMutex(global_tracker->mutex);
+	for (u32 i = 0; i < VLT_TRACK_MEMORY_SHARDS; ++i) {
+		global_alloc_shard_t *shard = &global_tracker->shards[i];
+		spinlock_lock(&shard->lock);
+		alloc_tracker_advance_gen(&shard->tracker);
+		spinlock_unlock(&shard->lock);
+	}
 #endif
 }
 
@@ -725,10 +1398,23 @@ void vlt_mem_log_usage_(size_t temp_bytes_current, size_t temp_pages_current,
 	log_info("memory diagnostic:");
 #ifdef VLT_TRACK_MEMORY
 	{
+		/* per-shard counters don't combine into a global peak,
+		 * so only the lists are merged - totals come from the global atomics */
 		global_alloc_tracker_t *global_tracker = g_allocator->udata;
-		SDL_LockMutex(global_tracker->mutex);
-		alloc_tracker_log_usage(&global_tracker->tracker, warn_active_allocations);
-		SDL_UnlockMutex(global_tracker->mutex);
+		log_info("***HEAP***");
+		if (warn_active_allocations) {
+			for (u32 i = 0; i < VLT_TRACK_MEMORY_SHARDS; ++i) {
+				global_alloc_shard_t *shard = &global_tracker->shards[i];
+				spinlock_lock(&shard->lock);
+				alloc_tracker__log_active_allocations(&shard->tracker);
+				spinlock_unlock(&shard->lock);
+			}
+		}
+		alloc_tracker__log_totals(vlt_atomic_load(&global_tracker->current_bytes),
+		                          vlt_atomic_load(&global_tracker->peak_bytes),
+		                          vlt_atomic_load(&global_tracker->total_bytes),
+		                          vlt_atomic_load(&global_tracker->total_chunks),
+		                          warn_active_allocations);
 	}
 #endif
 	log_info("***TEMP***");
@@ -744,30 +1430,110 @@ void vlt_mem_log_usage_(size_t temp_bytes_current, size_t temp_pages_current,
 
 void vlt_mem_log_usage(void)
 {
-	const pgb_t *pgb = g_temp_allocator->udata;
 	size_t bytes_used, pages_used, bytes_total, pages_total;
-	pgb_stats(pgb, &bytes_used, &pages_used, &bytes_total, &pages_total);
+	temp_memory__stats(&bytes_used, &pages_used, &bytes_total, &pages_total);
 	vlt_mem_log_usage_(bytes_used, pages_used, bytes_total, pages_total, false);
 }
 
+void vlt_mem_log_top_sites(size_t n)
+{
+#ifdef VLT_TRACK_MEMORY
+	/* NOTE: per-site peaks are summed across shards, so they are upper bounds */
+	global_alloc_tracker_t *global_tracker = g_allocator->udata;
+	alloc_tracker_t merged = {0};
+	for (u32 i = 0; i < VLT_TRACK_MEMORY_SHARDS; ++i) {
+		global_alloc_shard_t *shard = &global_tracker->shards[i];
+		spinlock_lock(&shard->lock);
+		for (size_t j = 0; j < shard->tracker.site_cap; ++j) {
+			const alloc_site_t *src = &shard->tracker.sites[j];
+			alloc_site_t *dst;
+			if (!src->location)
+				continue;
+			dst = alloc_tracker__site(&merged, src->location);
+			dst->live_count  += src->live_count;
+			dst->live_bytes  += src->live_bytes;
+			dst->peak_bytes  += src->peak_bytes;
+			dst->total_count += src->total_count;
+			dst->total_bytes += src->total_bytes;
+		}
+		spinlock_unlock(&shard->lock);
+	}
+	alloc_tracker_log_top_sites(&merged, n);
+	alloc_tracker_destroy(&merged);
+#endif
+}
+
+
+/* Hash */
+
+static inline
+u64 hash__read64(const u8 *p)
+{
+	u64 w;
+	memcpy(&w, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	w = __builtin_bswap64(w);
+#endif
+	return w;
+}
+
+static inline
+u64 hash__read_partial(const u8 *p, size_t n)
+{
+	u64 w = 0;
+	for (size_t i = 0; i < n; ++i)
+		w |= (u64)p[i] << (8 * i);
+	return w;
+}
+
+static inline
+u64 hash__rotl(u64 x, u32 r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline
+u64 hash__lane(u64 acc, u64 w)
+{
+	return hash__rotl(acc + w * HASH__K2, 31) * HASH__K1;
+}
+
+u64 hash64n(const void *data, size_t n)
+{
+	const u8 *p = data, *end = p + n;
+	u64 h = HASH__SEED ^ ((u64)n * HASH__K0);
+	if (n > HASH_SHORT_MAX) {
+		/* independent lanes keep several multiplies in flight */
+		u64 v[4] = { h, h + HASH__K1, h ^ HASH__K2, h - HASH__K3 };
+		for (; p + 32 <= end; p += 32) {
+			v[0] = hash__lane(v[0], hash__read64(p));
+			v[1] = hash__lane(v[1], hash__read64(p + 8));
+			v[2] = hash__lane(v[2], hash__read64(p + 16));
+			v[3] = hash__lane(v[3], hash__read64(p + 24));
+		}
+		h =   hash__rotl(v[0], 1) + hash__rotl(v[1], 7)
+		    + hash__rotl(v[2], 12) + hash__rotl(v[3], 18);
+	}
+	for (; p + 8 <= end; p += 8)
+		h = (h ^ hash__read64(p)) * HASH__K1;
+	if (p != end)
+		h = (h ^ hash__read_partial(p, end - p)) * HASH__K1;
+	return hash__fmix(h);
+}
 
-/* Hash (djb2 by dan bernstein) */
+u64 hash64(const char *str)
+{
+	return hash64n(str, strlen(str));
+}
 
 u32 hash(const char *str)
 {
-	u32 hash = 5381;
-	int c;
-	while ((c = *str++))
-		hash = ((hash << 5) + hash) + c;
-	return hash;
+	return (u32)hash64(str);
 }
 
 u32 hashn(const char *str, u32 n)
 {
-	u32 hash = 5381;
-	for (u32 i = 0; i < n; ++i)
-		hash = ((hash << 5) + hash) + (int)str[i];
-	return hash;
+	return (u32)hash64n(str, n);
 }
 
 void reverse(void *data, size_t size, size_t count)
@@ -786,15 +1552,13 @@ void reverse(void *data, size_t size, size_t count)
 void buf_insert_(void *p_, size_t idx, size_t nmemb, size_t size)
 {
 	char *p = p_;
-	for (char *pi = p+(nmemb-1)*size, *pn = p+idx*size; pi != pn; pi -= size)
-		memcpy(pi, pi-size, size);
+	memmove(p+(idx+1)*size, p+idx*size, (nmemb-1-idx)*size);
 }
 
 void buf_remove_(void *p_, size_t idx, size_t n, size_t nmemb, size_t size)
 {
 	char *p = p_;
-	for (char *pi = p+(idx+n)*size, *pn = p+nmemb*size; pi != pn; pi += size)
-		memcpy(pi-n*size, pi, size);
+	memmove(p+idx*size, p+(idx+n)*size, (nmemb-idx-n)*size);
 }
 
 /* Time */
@@ -962,15 +1726,8 @@ thread_local u32 g_profiler_depth = 0;
 void vlt_init(vlt_thread_type_e thread_type)
 {
 	g_error_handler  = &g_error_handler0;
-#ifdef VLT_TRACK_MEMORY
-	if (thread_type == VLT_THREAD_MAIN) {
-		global_alloc_tracker_t *global_tracker = g_allocator->udata;
-		global_tracker->mutex = SDL_CreateMutex();
-	}
-#endif
-	g_temp_allocator_ = allocator_create(pgb, &g_temp_allocator_pgb);
+	temp_memory__init(thread_type);
 	g_temp_allocator  = &g_temp_allocator_;
-	pgb_init(g_temp_allocator->udata, &g_temp_memory_heap);
 
 #if defined(_WIN32) && defined(DEBUG_HEAP)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_CHECK_ALWAYS_DF);
@@ -979,20 +1736,13 @@ void vlt_init(vlt_thread_type_e thread_type)
 
 void vlt_destroy(vlt_thread_type_e thread_type)
 {
-	pgb_t *pgb = g_temp_allocator->udata;
 	size_t bytes_used, pages_used, bytes_total, pages_total;
-	pgb_stats(pgb, &bytes_used, &pages_used, &bytes_total, &pages_total);
-	pgb_destroy(pgb);
-	pgb_heap_destroy(&g_temp_memory_heap);
-	vlt_mem_log_usage_(bytes_used, pages_used, bytes_total, pages_total,
-	                   thread_type == VLT_THREAD_MAIN);
+	temp_memory__stats(&bytes_used, &pages_used, &bytes_total, &pages_total);
+	temp_memory__destroy(thread_type);
+	if (thread_type != VLT_THREAD_WORKER)
+		vlt_mem_log_usage_(bytes_used, pages_used, bytes_total, pages_total,
+		                   thread_type == VLT_THREAD_MAIN);
 	g_temp_allocator = NULL;
-#ifdef VLT_TRACK_MEMORY
-	if (thread_type == VLT_THREAD_MAIN) {
-		global_alloc_tracker_t *global_tracker = g_allocator->udata;
-		SDL_DestroyMutex(global_tracker->mutex);
-	}
-#endif
 	g_error_handler  = NULL;
 }
 
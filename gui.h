@@ -1884,6 +1884,15 @@ typedef enum gui_vbo_type
 #define GUI_MAX_SCISSORS 32
 #endif
 
+/* inline capacity of the scratch buffers - larger inputs spill to the heap */
+#ifndef GUI_VERT_BUF_INLINE
+#define GUI_VERT_BUF_INLINE 128
+#endif
+
+#ifndef GUI_TXT_BUF_INLINE
+#define GUI_TXT_BUF_INLINE 256
+#endif
+
 typedef struct draw_call
 {
 	GLint idx;
@@ -1898,11 +1907,6 @@ typedef struct gui__scissor
 	s32 x, y, w, h;
 } gui__scissor_t;
 
-typedef struct cached_img
-{
-	img_t img;
-	u32 id;
-} cached_img_t;
 
 typedef enum gui_cursor
 {
@@ -1984,8 +1988,9 @@ typedef struct gui
 	SDL_Cursor *cursors[GUI__CURSOR_COUNT];
 	b32 use_default_cursor;
 	char font_file_path[256];
-	array(font_t) fonts;
-	cached_img_t *imgs;
+	hashmap(u32, font_t) fonts;
+	atom_table_t img_names;
+	array(img_t) imgs; /* indexed by the atom of the file name - 1 */
 	gui_style_t style;
 	u8 style_stack[GUI_STYLE_STACK_LIMIT];
 	u32 style_stack_sz;
@@ -2008,6 +2013,8 @@ typedef struct gui
 	v2i drag_offset;
 	char *pw_buf;
 	v2f *vert_buf;
+	array_sbo_storage(char, GUI_TXT_BUF_INLINE) pw_buf_storage;
+	array_sbo_storage(v2f, GUI_VERT_BUF_INLINE) vert_buf_storage;
 	struct
 	{
 		u64 id;
@@ -2208,8 +2215,9 @@ gui_t *gui_create_ex(s32 x, s32 y, s32 w, s32 h, const char *title,
 		if (!gui->cursors[i])
 			goto err_cursor;
 	strncpy(gui->font_file_path, font_file_path, sizeof(gui->font_file_path)-1);
-	gui->fonts = array_create();
-	gui->imgs = array_create();
+	hashmap_init(gui->fonts, u32, font_t);
+	atom_table_init(&gui->img_names);
+	array_init(gui->imgs, 0);
 
 	{
 		SDL_Event evt;
@@ -2250,8 +2258,8 @@ gui_t *gui_create_ex(s32 x, s32 y, s32 w, s32 h, const char *title,
 
 	gui->npt_cursor_pos = 0;
 	gui->drag_offset = g_v2i_zero;
-	gui->pw_buf = array_create();
-	gui->vert_buf = array_create();
+	array_init_sbo(gui->pw_buf, gui->pw_buf_storage);
+	array_init_sbo(gui->vert_buf, gui->vert_buf_storage);
 	gui->dragging_window = false;
 
 	gui->grid = NULL;
@@ -2306,12 +2314,13 @@ void gui_destroy(gui_t *gui)
 	array_destroy(gui->vert_buf);
 	for (u32 i = 0; i < GUI__CURSOR_COUNT; ++i)
 		SDL_FreeCursor(gui->cursors[i]);
-	array_foreach(gui->fonts, font_t, f)
-		font_destroy(f);
-	array_destroy(gui->fonts);
-	array_foreach(gui->imgs, cached_img_t, ci)
-		img_destroy(&ci->img);
+	hashmap_iterate(gui->fonts, i, n)
+		font_destroy(hashmap_val(gui->fonts, i));
+	hashmap_destroy(gui->fonts);
+	array_foreach(gui->imgs, img_t, img)
+		img_destroy(img);
 	array_destroy(gui->imgs);
+	atom_table_destroy(&gui->img_names);
 	shader_program_destroy(&gui->shader);
 	texture_destroy(&gui->texture_white);
 	texture_destroy(&gui->texture_white_dotted);
@@ -3264,29 +3273,18 @@ void gui_polyf(gui_t *gui, const v2f *v, u32 n, color_t fill, color_t stroke)
 	}
 }
 
-static
-cached_img_t *gui__find_img(gui_t *gui, u32 id)
-{
-	array_foreach(gui->imgs, cached_img_t, ci)
-		if (ci->id == id)
-			return ci;
-	return NULL;
-}
-
 static
 const img_t *gui__find_or_load_img(gui_t *gui, const char *fname)
 {
-	const u32 id = hash(fname);
-	cached_img_t *cached_img = gui__find_img(gui, id);
-	if (cached_img)
-		return &cached_img->img;
-
-	cached_img = array_append_null(gui->imgs);
-	cached_img->id = id;
-	if (img_load(&cached_img->img, fname))
-		return &cached_img->img;
-
-	array_pop(gui->imgs);
+	/* only file names are interned, so a new atom is always the next slot */
+	const atom_t id = atom_intern(&gui->img_names, fname);
+	img_t *img;
+	if (id > array_sz(gui->imgs))
+		memset(array_append_null(gui->imgs), 0, sizeof(img_t));
+	img = &gui->imgs[id - 1];
+	/* a failed load leaves the texture handle 0 & is retried next time */
+	if (img->texture.handle || img_load(img, fname))
+		return img;
 	return NULL;
 }
 
@@ -3330,19 +3328,13 @@ void gui_img_boxed(gui_t *gui, s32 x, s32 y, s32 w, s32 h, const char *fname,
 static inline
 font_t *gui__get_font(gui_t *gui, u32 sz)
 {
-	font_t *font = gui->fonts, *font_end = array_end(gui->fonts);
-	while (font != font_end && font->sz != sz)
-		++font;
-	if (font != font_end)
+	b32 inserted;
+	font_t *font = hashmap_insert_null_ex(gui->fonts, sz, &inserted);
+	if (!inserted || font_load(font, gui->font_file_path, sz))
 		return font;
 
-	font = array_append_null(gui->fonts);
-	if (font_load(font, gui->font_file_path, sz)) {
-		return font;
-	} else {
-		array_pop(gui->fonts);
-		return NULL;
-	}
+	hashmap_erase(gui->fonts, sz);
+	return NULL;
 }
 
 static
@@ -3411,6 +3403,7 @@ void gui__txt_char_pos(gui_t *gui, s32 *ix, s32 *iy, s32 w, s32 h,
 	s32 ix_ = *ix, iy_ = *iy;
 	r32 x, y;
 	stbtt_aligned_quad q;
+	array_sbo_storage(char, GUI_TXT_BUF_INLINE) buf_storage;
 	array(char) buf = NULL;
 	const char *txt = txt_;
 
@@ -3419,7 +3412,8 @@ void gui__txt_char_pos(gui_t *gui, s32 *ix, s32 *iy, s32 w, s32 h,
 
 	if (style->wrap) {
 		const u32 len = (u32)strlen(txt);
-		array_init_ex(buf, len + 1, g_temp_allocator);
+		array_init_sbo_ex(buf, buf_storage, g_temp_allocator);
+		array_reserve(buf, len + 1);
 		memcpy(buf, txt, len + 1);
 		gui__wrap_txt(gui, buf, style, w);
 		txt = buf;
@@ -3494,12 +3488,14 @@ u32 gui__txt_mouse_pos(gui_t *gui, s32 xi_, s32 yi_, s32 w, s32 h,
 	u32 closest_pos;
 	s32 closest_dist, dist;
 	v2i p;
+	array_sbo_storage(char, GUI_TXT_BUF_INLINE) buf_storage;
 	array(char) buf = NULL;
 	const char *txt = txt_;
 
 	if (style->wrap) {
 		const u32 len = (u32)strlen(txt);
-		array_init_ex(buf, len + 1, g_temp_allocator);
+		array_init_sbo_ex(buf, buf_storage, g_temp_allocator);
+		array_reserve(buf, len + 1);
 		memcpy(buf, txt, len + 1);
 		gui__wrap_txt(gui, buf, style, w);
 		txt = buf;
@@ -3651,12 +3647,14 @@ void gui_txt_styled(gui_t *gui, s32 x, s32 y, s32 w, s32 h,
                     const char *txt, const gui_text_style_t *style)
 {
 	const u32 len = (u32)strlen(txt);
+	array_sbo_storage(char, GUI_TXT_BUF_INLINE) buf_storage;
 	array(char) buf;
 
 	font__align_anchor(&x, &y, w, h, style->align);
 
 	if (style->wrap) {
-		array_init_ex(buf, len + 1, g_temp_allocator);
+		array_init_sbo_ex(buf, buf_storage, g_temp_allocator);
+		array_reserve(buf, len + 1);
 		memcpy(buf, txt, len + 1);
 		gui__wrap_txt(gui, buf, style, w);
 		gui__txt(gui, &x, &y, buf, style);
@@ -0,0 +1,347 @@
+#ifndef VIOLET_HASHMAP_H
+#define VIOLET_HASHMAP_H
+
+/*
+ * Open addressing hash map with Robin Hood probing.
+ *
+ * Entries (key followed by value) are packed into an array, so iterating is a
+ * linear walk & erasing moves the last entry into the hole. A separate, power
+ * of two sized slot table maps hashes to entry indices. Every slot keeps the
+ * 32-bit hash of its key, so most mismatches never touch the entries, and
+ * probe distances are recomputed from it instead of being stored.
+ *
+ * Keys & values are passed by address (as lvalues) and copied bytewise.
+ * Pointers into the map are valid until the next insertion or erase.
+ */
+
+#ifdef HASHMAP_STATIC
+#define HMDEF static
+#else
+#define HMDEF
+#endif
+
+#if defined HASHMAP_STATIC && !defined HASHMAP_IMPLEMENTATION
+#define HASHMAP_IMPLEMENTATION
+#endif
+
+#ifndef HASHMAP_MAX_LOAD_PERCENT
+#define HASHMAP_MAX_LOAD_PERCENT 80
+#endif
+
+typedef u64 (*hashmap_hash_f)(const void *key, size_t key_sz);
+typedef b32 (*hashmap_eq_f)(const void *lhs, const void *rhs, size_t key_sz);
+
+typedef struct hashmap__slot
+{
+	u32 hash; /* 0 = empty */
+	u32 idx;
+} hashmap__slot_t;
+
+typedef struct hashmap
+{
+	void *entries;
+	hashmap__slot_t *slots;
+	u32 slot_cap;
+	u32 key_sz, val_sz, val_offset, entry_sz;
+	hashmap_hash_f hash;
+	hashmap_eq_f eq;
+	allocator_t *allocator;
+} hashmap_t;
+
+#define hashmap(K, V) hashmap_t
+
+#define hashmap_init(m, K, V)         hashmap_init_ex(m, K, V, g_allocator)
+#define hashmap_init_ex(m, K, V, alc) hashmap_init_custom(m, K, V, hashmap_hash_bytes, \
+                                                          hashmap_eq_bytes, alc)
+/* keys are (const char *) & hashed by content - the map doesn't own them */
+#define hashmap_init_str(m, V)        hashmap_init_str_ex(m, V, g_allocator)
+#define hashmap_init_str_ex(m, V, alc) \
+                                      hashmap_init_custom(m, const char*, V, hashmap_hash_str, \
+                                                          hashmap_eq_str, alc)
+#define hashmap_init_custom(m, K, V, hash_fn, eq_fn, alc) \
+                                      hashmap__init(&(m), sizeof(K), _Alignof(K), \
+                                                    sizeof(V), _Alignof(V), hash_fn, \
+                                                    eq_fn, alc  MEMCALL_LOCATION)
+#define hashmap_destroy(m)            hashmap__destroy(&(m)  MEMCALL_LOCATION)
+
+#define hashmap_sz(m)                 array_sz((m).entries)
+#define hashmap_empty(m)              (hashmap_sz(m) == 0)
+#define hashmap_reserve(m, n)         hashmap__reserve(&(m), n  MEMCALL_LOCATION)
+#define hashmap_clear(m)              hashmap__clear(&(m))
+
+#define hashmap_get(m, k)             hashmap__get(&(m), &(k))
+#define hashmap_contains(m, k)        (hashmap_get(m, k) != NULL)
+#define hashmap_set(m, k, v)          hashmap__set(&(m), &(k), &(v)  MEMCALL_LOCATION)
+/* returns the value for k, zero-initialized if k was not in the map yet */
+#define hashmap_insert_null(m, k)     hashmap_insert_null_ex(m, k, NULL)
+#define hashmap_insert_null_ex(m, k, inserted) \
+                                      hashmap__insert_null(&(m), &(k), inserted \
+                                                           MEMCALL_LOCATION)
+#define hashmap_erase(m, k)           hashmap__erase(&(m), &(k))
+
+#define hashmap_key(m, i)             ((void*)((u8*)(m).entries + (i) * (m).entry_sz))
+#define hashmap_val(m, i)             ((void*)(  (u8*)(m).entries + (i) * (m).entry_sz \
+                                               + (m).val_offset))
+#define hashmap_iterate(m, it, n)     for (u32 it = 0, n = hashmap_sz(m); it < n; ++it)
+
+
+HMDEF void  hashmap__init(hashmap_t *m, size_t key_sz, size_t key_align,
+                          size_t val_sz, size_t val_align, hashmap_hash_f hash,
+                          hashmap_eq_f eq, allocator_t *a  MEMCALL_ARGS);
+HMDEF void  hashmap__destroy(hashmap_t *m  MEMCALL_ARGS);
+HMDEF void  hashmap__reserve(hashmap_t *m, u32 n  MEMCALL_ARGS);
+HMDEF void  hashmap__clear(hashmap_t *m);
+HMDEF void *hashmap__get(const hashmap_t *m, const void *key);
+HMDEF void *hashmap__set(hashmap_t *m, const void *key, const void *val
+                         MEMCALL_ARGS);
+HMDEF void *hashmap__insert_null(hashmap_t *m, const void *key, b32 *inserted
+                                 MEMCALL_ARGS);
+HMDEF b32   hashmap__erase(hashmap_t *m, const void *key);
+
+HMDEF void  hashmap_stats(const hashmap_t *m, r32 *load_factor,
+                          r32 *avg_probe_len, u32 *max_probe_len);
+
+HMDEF u64   hashmap_hash_bytes(const void *key, size_t key_sz);
+HMDEF b32   hashmap_eq_bytes(const void *lhs, const void *rhs, size_t key_sz);
+HMDEF u64   hashmap_hash_str(const void *key, size_t key_sz);
+HMDEF b32   hashmap_eq_str(const void *lhs, const void *rhs, size_t key_sz);
+
+#endif // VIOLET_HASHMAP_H
+
+#ifdef HASHMAP_IMPLEMENTATION
+
+#define HASHMAP__MIN_SLOTS 16
+
+#define hashmap__entry(m, i)     ((u8*)(m)->entries + (size_t)(i) * (m)->entry_sz)
+#define hashmap__dist(h, i, msk) (((i) - (h)) & (msk))
+
+static
+size_t hashmap__align(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static
+u32 hashmap__hash(const hashmap_t *m, const void *key)
+{
+	const u32 h = (u32)m->hash(key, m->key_sz);
+	return h ? h : 1;
+}
+
+/* returns slot_cap if not found */
+static
+u32 hashmap__find(const hashmap_t *m, const void *key, u32 h)
+{
+	const u32 mask = m->slot_cap - 1;
+	if (!m->slot_cap)
+		return 0;
+	for (u32 i = h & mask, dist = 0; ; i = (i + 1) & mask, ++dist) {
+		const hashmap__slot_t *slot = &m->slots[i];
+		/* a richer slot means key would have displaced it */
+		if (!slot->hash || hashmap__dist(slot->hash, i, mask) < dist)
+			return m->slot_cap;
+		if (slot->hash == h && m->eq(hashmap__entry(m, slot->idx), key, m->key_sz))
+			return i;
+	}
+}
+
+static
+void hashmap__slot_insert(hashmap_t *m, u32 h, u32 idx)
+{
+	const u32 mask = m->slot_cap - 1;
+	hashmap__slot_t cur = { .hash = h, .idx = idx };
+	for (u32 i = h & mask, dist = 0; ; i = (i + 1) & mask, ++dist) {
+		hashmap__slot_t *slot = &m->slots[i];
+		u32 slot_dist;
+		if (!slot->hash) {
+			*slot = cur;
+			return;
+		}
+		slot_dist = hashmap__dist(slot->hash, i, mask);
+		if (slot_dist < dist) {
+			const hashmap__slot_t tmp = *slot;
+			*slot = cur;
+			cur = tmp;
+			dist = slot_dist;
+		}
+	}
+}
+
+static
+void hashmap__rehash(hashmap_t *m, u32 slot_cap  MEMCALL_ARGS)
+{
+	hashmap__slot_t *old_slots = m->slots;
+	const u32 old_cap = m->slot_cap;
+	m->slots = m->allocator->calloc_(slot_cap, sizeof(hashmap__slot_t), m->allocator
+	                                 MEMCALL_VARS);
+	error_if(!m->slots, "hashmap__rehash: oom");
+	m->slot_cap = slot_cap;
+	for (u32 i = 0; i < old_cap; ++i)
+		if (old_slots[i].hash)
+			hashmap__slot_insert(m, old_slots[i].hash, old_slots[i].idx);
+	if (old_slots)
+		m->allocator->free_(old_slots, m->allocator  MEMCALL_VARS);
+}
+
+static
+u32 hashmap__slots_for(u32 n)
+{
+	u32 slot_cap = HASHMAP__MIN_SLOTS;
+	while ((u64)n * 100 > (u64)slot_cap * HASHMAP_MAX_LOAD_PERCENT)
+		slot_cap *= 2;
+	return slot_cap;
+}
+
+HMDEF void hashmap__init(hashmap_t *m, size_t key_sz, size_t key_align,
+                         size_t val_sz, size_t val_align, hashmap_hash_f hash,
+                         hashmap_eq_f eq, allocator_t *a  MEMCALL_ARGS)
+{
+	const size_t entry_align = key_align > val_align ? key_align : val_align;
+	m->key_sz     = (u32)key_sz;
+	m->val_sz     = (u32)val_sz;
+	m->val_offset = (u32)hashmap__align(key_sz, val_align);
+	m->entry_sz   = (u32)hashmap__align(m->val_offset + val_sz, entry_align);
+	m->entries    = array__create(0, m->entry_sz, a  MEMCALL_VARS);
+	m->slots      = NULL;
+	m->slot_cap   = 0;
+	m->hash       = hash;
+	m->eq         = eq;
+	m->allocator  = a;
+}
+
+HMDEF void hashmap__destroy(hashmap_t *m  MEMCALL_ARGS)
+{
+	array_destroy(m->entries);
+	if (m->slots)
+		m->allocator->free_(m->slots, m->allocator  MEMCALL_VARS);
+	m->entries  = NULL;
+	m->slots    = NULL;
+	m->slot_cap = 0;
+}
+
+HMDEF void hashmap__reserve(hashmap_t *m, u32 n  MEMCALL_ARGS)
+{
+	const u32 slot_cap = hashmap__slots_for(n);
+	if (slot_cap > m->slot_cap)
+		hashmap__rehash(m, slot_cap  MEMCALL_VARS);
+	m->entries = array__reserve(m->entries, n, m->entry_sz  MEMCALL_VARS);
+}
+
+HMDEF void hashmap__clear(hashmap_t *m)
+{
+	array_clear(m->entries);
+	if (m->slots)
+		memset(m->slots, 0, m->slot_cap * sizeof(hashmap__slot_t));
+}
+
+HMDEF void *hashmap__get(const hashmap_t *m, const void *key)
+{
+	const u32 i = hashmap__find(m, key, hashmap__hash(m, key));
+	return i != m->slot_cap ? hashmap__entry(m, m->slots[i].idx) + m->val_offset : NULL;
+}
+
+HMDEF void *hashmap__insert_null(hashmap_t *m, const void *key, b32 *inserted
+                                 MEMCALL_ARGS)
+{
+	const u32 h = hashmap__hash(m, key);
+	const u32 i = hashmap__find(m, key, h);
+	const u32 idx = array_sz(m->entries);
+	u8 *entry;
+	if (i != m->slot_cap) {
+		if (inserted)
+			*inserted = false;
+		return hashmap__entry(m, m->slots[i].idx) + m->val_offset;
+	}
+	if ((u64)(idx + 1) * 100 > (u64)m->slot_cap * HASHMAP_MAX_LOAD_PERCENT)
+		hashmap__rehash(m, hashmap__slots_for(idx + 1)  MEMCALL_VARS);
+	m->entries = array__append_null(m->entries, m->entry_sz  MEMCALL_VARS);
+	entry = hashmap__entry(m, idx);
+	memset(entry, 0, m->entry_sz);
+	memcpy(entry, key, m->key_sz);
+	hashmap__slot_insert(m, h, idx);
+	if (inserted)
+		*inserted = true;
+	return entry + m->val_offset;
+}
+
+HMDEF void *hashmap__set(hashmap_t *m, const void *key, const void *val
+                         MEMCALL_ARGS)
+{
+	void *dst = hashmap__insert_null(m, key, NULL  MEMCALL_VARS);
+	memcpy(dst, val, m->val_sz);
+	return dst;
+}
+
+HMDEF b32 hashmap__erase(hashmap_t *m, const void *key)
+{
+	const u32 mask = m->slot_cap - 1;
+	u32 i = hashmap__find(m, key, hashmap__hash(m, key));
+	u32 idx, last;
+	if (i == m->slot_cap)
+		return false;
+
+	/* backward shift deletion - no tombstones */
+	idx = m->slots[i].idx;
+	for (u32 j = (i + 1) & mask;
+	     m->slots[j].hash && hashmap__dist(m->slots[j].hash, j, mask) > 0;
+	     i = j, j = (j + 1) & mask)
+		m->slots[i] = m->slots[j];
+	m->slots[i].hash = 0;
+
+	/* move the last entry into the hole */
+	last = array_sz(m->entries) - 1;
+	if (idx != last) {
+		const u8 *last_entry = hashmap__entry(m, last);
+		const u32 h = hashmap__hash(m, last_entry);
+		u32 j = h & mask;
+		while (m->slots[j].idx != last || m->slots[j].hash != h)
+			j = (j + 1) & mask;
+		m->slots[j].idx = idx;
+	}
+	array__remove_fast(m->entries, idx, m->entry_sz);
+	return true;
+}
+
+HMDEF void hashmap_stats(const hashmap_t *m, r32 *load_factor,
+                         r32 *avg_probe_len, u32 *max_probe_len)
+{
+	const u32 mask = m->slot_cap - 1;
+	u64 total_dist = 0;
+	u32 max_dist = 0;
+	for (u32 i = 0; i < m->slot_cap; ++i) {
+		if (m->slots[i].hash) {
+			const u32 dist = hashmap__dist(m->slots[i].hash, i, mask);
+			total_dist += dist;
+			if (dist > max_dist)
+				max_dist = dist;
+		}
+	}
+	*load_factor   = m->slot_cap ? (r32)hashmap_sz(*m) / m->slot_cap : 0.f;
+	*avg_probe_len = hashmap_sz(*m) ? 1.f + (r32)total_dist / hashmap_sz(*m) : 0.f;
+	*max_probe_len = hashmap_sz(*m) ? max_dist + 1 : 0;
+}
+
+HMDEF u64 hashmap_hash_bytes(const void *key, size_t key_sz)
+{
+	return hash64n(key, key_sz);
+}
+
+HMDEF b32 hashmap_eq_bytes(const void *lhs, const void *rhs, size_t key_sz)
+{
+	return memcmp(lhs, rhs, key_sz) == 0;
+}
+
+HMDEF u64 hashmap_hash_str(const void *key, size_t key_sz)
+{
+	UNUSED(key_sz);
+	return hash64(*(const char *const*)key);
+}
+
+HMDEF b32 hashmap_eq_str(const void *lhs, const void *rhs, size_t key_sz)
+{
+	UNUSED(key_sz);
+	return strcmp(*(const char *const*)lhs, *(const char *const*)rhs) == 0;
+}
+
+#undef HASHMAP_IMPLEMENTATION
+#endif // HASHMAP_IMPLEMENTATION
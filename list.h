@@ -11,6 +11,14 @@
 #define LIST_IMPLEMENTATION
 #endif
 
+#ifndef LIST_POOL_CHUNK_NODES
+#define LIST_POOL_CHUNK_NODES 64
+#endif
+
+#ifndef ULIST_CHUNK_BYTES
+#define ULIST_CHUNK_BYTES 512
+#endif
+
 typedef struct list
 {
 	size_t sz;
@@ -35,61 +43,472 @@ typedef struct list__item_header
 #define list__item_header(i)      (((list__item_header_t*)(i))[-1])
 #define list_prev(i)              list__item_header(i).prev
 #define list_next(i)              list__item_header(i).next
-#define list_append(l, i)         list__append(&(l), &(i), sizeof(i)  MEMCALL_LOCATION)
-#define list_pop(l)               list__pop(&(l)  MEMCALL_LOCATION)
+#define list_append(l, i)         list__insert(&(l), NULL, &(i), sizeof(i)  MEMCALL_LOCATION)
+#define list_prepend(l, i)        list__insert(&(l), (l).head, &(i), sizeof(i) \
+                                               MEMCALL_LOCATION)
+/* pos is an item of l - NULL inserts at the end */
+#define list_insert_before(l, pos, i) \
+                                  list__insert(&(l), pos, &(i), sizeof(i)  MEMCALL_LOCATION)
+#define list_insert_after(l, pos, i) \
+                                  list__insert(&(l), list_next(pos), &(i), sizeof(i) \
+                                               MEMCALL_LOCATION)
+#define list_remove(l, i)         list__remove(&(l), i  MEMCALL_LOCATION)
+#define list_pop(l)               list__remove(&(l), (l).tail  MEMCALL_LOCATION)
+#define list_pop_front(l)         list__remove(&(l), (l).head  MEMCALL_LOCATION)
+/* moves every item of src in front of pos (NULL: the end) in dst - both lists
+ * must share an allocator */
+#define list_splice(dst, pos, src) list__splice(&(dst), pos, &(src))
 #define list_foreach(l, type, i)  for (type *i = (l).head; i != NULL; \
                                        i = list_next(i))
 #define list_destroy(l)           list__destroy(&(l)  MEMCALL_LOCATION)
 
 
-LSTDEF void *list__append(list_t *list, const void *item_, size_t sz  MEMCALL_ARGS);
-LSTDEF void  list__pop(list_t *list  MEMCALL_ARGS);
+LSTDEF void *list__insert(list_t *list, void *pos, const void *item_, size_t sz
+                          MEMCALL_ARGS);
+LSTDEF void  list__remove(list_t *list, void *item  MEMCALL_ARGS);
+LSTDEF void  list__splice(list_t *dst, void *pos, list_t *src);
 LSTDEF void  list__destroy(list_t *list  MEMCALL_ARGS);
 
+
+/* Node pool
+ *
+ * Serves the fixed-size nodes of one or more lists from chunks of
+ * LIST_POOL_CHUNK_NODES nodes - removed nodes are recycled, and the chunks
+ * are only returned to the parent allocator by list_pool_destroy.
+ */
+typedef struct list_pool
+{
+	allocator_t allocator;
+	allocator_t *parent;
+	size_t node_sz;
+	void *free_nodes;
+	void *chunks;
+} list_pool_t;
+
+#define list_pool_init(p, type)         list_pool_init_ex(p, type, g_allocator)
+#define list_pool_init_ex(p, type, alc) list__pool_init(p, sizeof(type), alc)
+#define list_create_pooled(p)           list_create_ex(&(p)->allocator)
+
+LSTDEF void list__pool_init(list_pool_t *pool, size_t sz, allocator_t *a);
+LSTDEF void list_pool_destroy(list_pool_t *pool);
+
+
+/* Intrusive list
+ *
+ * Items embed an ilist_node_t & are owned by the caller - the list never
+ * allocates. Every operation is O(1).
+ */
+typedef struct ilist_node
+{
+	struct ilist_node *prev, *next;
+} ilist_node_t;
+
+typedef struct ilist
+{
+	size_t sz;
+	ilist_node_t *head, *tail;
+} ilist_t;
+
+#define ilist_create()                   (ilist_t){ 0 }
+#define ilist_sz(l)                      (l).sz
+#define ilist_empty(l)                   (ilist_sz(l) == 0)
+#define ilist_entry(node, type, member)  ((type*)((char*)(node) - offsetof(type, member)))
+#define ilist_push_back(l, node)         ilist_insert_before(l, NULL, node)
+#define ilist_push_front(l, node)        ilist_insert_before(l, (l).head, node)
+#define ilist_insert_before(l, pos, node) ilist__insert(&(l), pos, node)
+#define ilist_insert_after(l, pos, node) ilist__insert(&(l), (pos)->next, node)
+#define ilist_remove(l, node)            ilist__remove(&(l), node)
+#define ilist_splice(dst, pos, src)      ilist__splice(&(dst), pos, &(src))
+/* node may be removed while iterating - use ilist_entry to get the item */
+#define ilist_foreach(l, node) \
+	for (ilist_node_t *node = (l).head, *node##_next_; \
+	     node && (node##_next_ = node->next, 1); node = node##_next_)
+
+LSTDEF void ilist__insert(ilist_t *list, ilist_node_t *pos, ilist_node_t *node);
+LSTDEF void ilist__remove(ilist_t *list, ilist_node_t *node);
+LSTDEF void ilist__splice(ilist_t *dst, ilist_node_t *pos, ilist_t *src);
+
+
+/* Unrolled list
+ *
+ * Items are stored contiguously in chunks of ULIST_CHUNK_BYTES, so iterating
+ * touches one pointer per chunk rather than one per item. Appending & popping
+ * at either end are O(1) & never move other items.
+ */
+typedef struct ulist__chunk
+{
+	struct ulist__chunk *prev, *next;
+	u32 begin, end;
+} ulist__chunk_t;
+
+typedef struct ulist
+{
+	size_t sz;
+	ulist__chunk_t *head, *tail;
+	u32 chunk_cap;
+	allocator_t *allocator;
+} ulist_t;
+
+#define ulist(type)               ulist_t
+
+#define ULIST__DATA_OFFSET        ((sizeof(ulist__chunk_t) + 15) & ~(size_t)15)
+#define ulist__data(c)            ((char*)(c) + ULIST__DATA_OFFSET)
+#define ulist__chunk_cap(sz)      (  (sz) * 4 + ULIST__DATA_OFFSET <= ULIST_CHUNK_BYTES \
+                                   ? (u32)((ULIST_CHUNK_BYTES - ULIST__DATA_OFFSET) / (sz)) \
+                                   : 4)
+
+#define ulist_create(type)        ulist_create_ex(type, g_allocator)
+#define ulist_create_ex(type, a)  (ulist_t){ .chunk_cap = ulist__chunk_cap(sizeof(type)), \
+                                             .allocator = a }
+#define ulist_sz(l)               (l).sz
+#define ulist_empty(l)            (ulist_sz(l) == 0)
+#define ulist_append_null(l, type) ((type*)ulist__push(&(l), sizeof(type), false \
+                                                       MEMCALL_LOCATION))
+#define ulist_append(l, type, e)  (*ulist_append_null(l, type) = (e))
+#define ulist_prepend_null(l, type) ((type*)ulist__push(&(l), sizeof(type), true \
+                                                        MEMCALL_LOCATION))
+#define ulist_prepend(l, type, e) (*ulist_prepend_null(l, type) = (e))
+#define ulist_first(l, type)      ((type*)ulist__data((l).head) + (l).head->begin)
+#define ulist_last(l, type)       ((type*)ulist__data((l).tail) + (l).tail->end - 1)
+#define ulist_get(l, type, i)     ((type*)ulist__get(&(l), i, sizeof(type)))
+#define ulist_pop(l)              ulist__pop(&(l), false  MEMCALL_LOCATION)
+#define ulist_pop_front(l)        ulist__pop(&(l), true  MEMCALL_LOCATION)
+/* the outer loop only declares the chunk - the inner one moves on to the
+ * next chunk (never empty) at the end of each, so break works as usual */
+#define ulist_foreach(l, type, it) \
+	for (ulist__chunk_t *it##_c_ = (l).head; it##_c_; it##_c_ = NULL) \
+		for (type *it = (type*)ulist__data(it##_c_) + it##_c_->begin, \
+		          *it##_end_ = (type*)ulist__data(it##_c_) + it##_c_->end; \
+		        it != it##_end_ \
+		     || (   (it##_c_ = it##_c_->next) != NULL \
+		         && (it = (type*)ulist__data(it##_c_) + it##_c_->begin, \
+		             it##_end_ = (type*)ulist__data(it##_c_) + it##_c_->end, 1)); \
+		     ++it)
+#define ulist_clear(l)            ulist__clear(&(l)  MEMCALL_LOCATION)
+#define ulist_destroy(l)          ulist__clear(&(l)  MEMCALL_LOCATION)
+
+LSTDEF void *ulist__push(ulist_t *list, size_t sz, b32 front  MEMCALL_ARGS);
+LSTDEF void  ulist__pop(ulist_t *list, b32 front  MEMCALL_ARGS);
+LSTDEF void *ulist__get(const ulist_t *list, size_t idx, size_t sz);
+LSTDEF void  ulist__clear(ulist_t *list  MEMCALL_ARGS);
+
 #endif // VIOLET_LIST_H
 
 #ifdef LIST_IMPLEMENTATION
 
-LSTDEF void *list__append(list_t *list, const void *item_, size_t sz  MEMCALL_ARGS)
+LSTDEF void *list__insert(list_t *list, void *pos, const void *item_, size_t sz
+                          MEMCALL_ARGS)
 {
 	const size_t item_sz = sz + sizeof(list__item_header_t);
 	allocator_t *a = list__allocator(*list);
 	list__item_header_t *header = a->malloc_(item_sz, a  MEMCALL_VARS);
 	void *item = header + 1;
-	error_if(!header, "list__append: oom");
-	memset(header, 0, sizeof(list__item_header_t));
+	error_if(!header, "list__insert: oom");
 	memcpy(item, item_, sz);
-	if (!list->head) {
-		list->head = list->tail = item;
-		header->prev = header->next = NULL;
+	header->next = pos;
+	if (pos) {
+		header->prev = list_prev(pos);
+		list_prev(pos) = item;
 	} else {
-		list_next(list->tail) = item;
 		header->prev = list->tail;
 		list->tail = item;
 	}
+	if (header->prev)
+		list_next(header->prev) = item;
+	else
+		list->head = item;
 	++list->sz;
 	return item;
 }
 
-LSTDEF void list__pop(list_t *list  MEMCALL_ARGS)
+LSTDEF void list__remove(list_t *list, void *item  MEMCALL_ARGS)
 {
-	list__item_header_t *tail_header;
+	list__item_header_t *header;
 	allocator_t *a = list__allocator(*list);
-	assert(list->tail);
-	tail_header = &list__item_header(list->tail);
-	list->tail = tail_header->prev;
-	if (list->tail)
-		list__item_header(list->tail).next = NULL;
+	assert(item);
+	header = &list__item_header(item);
+	if (header->prev)
+		list_next(header->prev) = header->next;
 	else
-		list->head = NULL;
-	a->free_(tail_header, a  MEMCALL_VARS);
+		list->head = header->next;
+	if (header->next)
+		list_prev(header->next) = header->prev;
+	else
+		list->tail = header->prev;
+	a->free_(header, a  MEMCALL_VARS);
 	--list->sz;
 }
 
+LSTDEF void list__splice(list_t *dst, void *pos, list_t *src)
+{
+	void *prev;
+	assert(dst->allocator == src->allocator);
+	if (list_empty(*src))
+		return;
+	prev = pos ? list_prev(pos) : dst->tail;
+	list_prev(src->head) = prev;
+	if (prev)
+		list_next(prev) = src->head;
+	else
+		dst->head = src->head;
+	list_next(src->tail) = pos;
+	if (pos)
+		list_prev(pos) = src->tail;
+	else
+		dst->tail = src->tail;
+	dst->sz += src->sz;
+	src->head = src->tail = NULL;
+	src->sz = 0;
+}
+
 LSTDEF void list__destroy(list_t *list  MEMCALL_ARGS)
 {
 	while (!list_empty(*list))
-		list__pop(list  MEMCALL_VARS);
+		list__remove(list, list->tail  MEMCALL_VARS);
+}
+
+/* Node pool */
+
+#define LIST__POOL_ALIGNMENT 16
+
+static
+void *list__pool_malloc(size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	list_pool_t *pool = a->udata;
+	void *node;
+	error_if(size > pool->node_sz, "list_pool: node too large");
+	if (!pool->free_nodes) {
+		const size_t chunk_sz = LIST__POOL_ALIGNMENT
+		                      + LIST_POOL_CHUNK_NODES * pool->node_sz;
+		char *chunk = pool->parent->malloc_(chunk_sz, pool->parent  MEMCALL_VARS);
+		if (!chunk)
+			return NULL;
+		*(void**)chunk = pool->chunks;
+		pool->chunks = chunk;
+		for (u32 i = LIST_POOL_CHUNK_NODES; i > 0; --i) {
+			node = chunk + LIST__POOL_ALIGNMENT + (i - 1) * pool->node_sz;
+			*(void**)node = pool->free_nodes;
+			pool->free_nodes = node;
+		}
+	}
+	node = pool->free_nodes;
+	pool->free_nodes = *(void**)node;
+	return node;
+}
+
+static
+void *list__pool_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	void *node = list__pool_malloc(nmemb * size, a  MEMCALL_VARS);
+	if (node)
+		memset(node, 0, nmemb * size);
+	return node;
+}
+
+static
+void list__pool_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
+{
+	list_pool_t *pool = a->udata;
+	if (ptr) {
+		*(void**)ptr = pool->free_nodes;
+		pool->free_nodes = ptr;
+	}
+}
+
+static
+void *list__pool_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	list_pool_t *pool = a->udata;
+	if (!ptr)
+		return list__pool_malloc(size, a  MEMCALL_VARS);
+	if (!size) {
+		list__pool_free(ptr, a  MEMCALL_VARS);
+		return NULL;
+	}
+	error_if(size > pool->node_sz, "list_pool: node too large");
+	return ptr;
+}
+
+static
+void *list__pool_malloc_aligned(size_t size, size_t alignment, allocator_t *a
+                                MEMCALL_ARGS)
+{
+	error_if(alignment > LIST__POOL_ALIGNMENT, "list_pool: unsupported alignment");
+	return list__pool_malloc(size, a  MEMCALL_VARS);
+}
+
+static
+void *list__pool_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                                 allocator_t *a  MEMCALL_ARGS)
+{
+	error_if(alignment > LIST__POOL_ALIGNMENT, "list_pool: unsupported alignment");
+	return list__pool_realloc(ptr, size, a  MEMCALL_VARS);
+}
+
+LSTDEF void list__pool_init(list_pool_t *pool, size_t sz, allocator_t *a)
+{
+	const size_t node_sz = sizeof(list__item_header_t) + sz;
+	pool->allocator  = allocator_create(list__pool, pool);
+	pool->parent     = a;
+	pool->node_sz    = (node_sz + LIST__POOL_ALIGNMENT - 1) & ~(LIST__POOL_ALIGNMENT - 1);
+	pool->free_nodes = NULL;
+	pool->chunks     = NULL;
+}
+
+LSTDEF void list_pool_destroy(list_pool_t *pool)
+{
+	while (pool->chunks) {
+		void *next = *(void**)pool->chunks;
+		afree(pool->chunks, pool->parent);
+		pool->chunks = next;
+	}
+	pool->free_nodes = NULL;
+}
+
+/* Intrusive list */
+
+LSTDEF void ilist__insert(ilist_t *list, ilist_node_t *pos, ilist_node_t *node)
+{
+	node->next = pos;
+	if (pos) {
+		node->prev = pos->prev;
+		pos->prev = node;
+	} else {
+		node->prev = list->tail;
+		list->tail = node;
+	}
+	if (node->prev)
+		node->prev->next = node;
+	else
+		list->head = node;
+	++list->sz;
+}
+
+LSTDEF void ilist__remove(ilist_t *list, ilist_node_t *node)
+{
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		list->head = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+	else
+		list->tail = node->prev;
+	node->prev = node->next = NULL;
+	--list->sz;
+}
+
+LSTDEF void ilist__splice(ilist_t *dst, ilist_node_t *pos, ilist_t *src)
+{
+	ilist_node_t *prev;
+	if (ilist_empty(*src))
+		return;
+	prev = pos ? pos->prev : dst->tail;
+	src->head->prev = prev;
+	if (prev)
+		prev->next = src->head;
+	else
+		dst->head = src->head;
+	src->tail->next = pos;
+	if (pos)
+		pos->prev = src->tail;
+	else
+		dst->tail = src->tail;
+	dst->sz += src->sz;
+	*src = ilist_create();
+}
+
+/* Unrolled list */
+
+static
+ulist__chunk_t *ulist__chunk_create(ulist_t *list, size_t sz, u32 begin  MEMCALL_ARGS)
+{
+	allocator_t *a = list->allocator;
+	ulist__chunk_t *chunk = a->malloc_(ULIST__DATA_OFFSET + list->chunk_cap * sz,
+	                                   a  MEMCALL_VARS);
+	error_if(!chunk, "ulist: oom");
+	chunk->prev = chunk->next = NULL;
+	chunk->begin = chunk->end = begin;
+	return chunk;
+}
+
+LSTDEF void *ulist__push(ulist_t *list, size_t sz, b32 front  MEMCALL_ARGS)
+{
+	ulist__chunk_t *chunk;
+	if (front) {
+		chunk = list->head;
+		if (!chunk || chunk->begin == 0) {
+			/* fill new front chunks from the back, so repeated prepends stay O(1) */
+			chunk = ulist__chunk_create(list, sz, list->chunk_cap  MEMCALL_VARS);
+			chunk->next = list->head;
+			if (list->head)
+				list->head->prev = chunk;
+			else
+				list->tail = chunk;
+			list->head = chunk;
+		}
+		++list->sz;
+		return ulist__data(chunk) + --chunk->begin * sz;
+	} else {
+		chunk = list->tail;
+		if (!chunk || chunk->end == list->chunk_cap) {
+			chunk = ulist__chunk_create(list, sz, 0  MEMCALL_VARS);
+			chunk->prev = list->tail;
+			if (list->tail)
+				list->tail->next = chunk;
+			else
+				list->head = chunk;
+			list->tail = chunk;
+		}
+		++list->sz;
+		return ulist__data(chunk) + chunk->end++ * sz;
+	}
+}
+
+LSTDEF void ulist__pop(ulist_t *list, b32 front  MEMCALL_ARGS)
+{
+	ulist__chunk_t *chunk = front ? list->head : list->tail;
+	assert(chunk);
+	if (front)
+		++chunk->begin;
+	else
+		--chunk->end;
+	--list->sz;
+	if (chunk->begin == chunk->end) {
+		if (chunk->prev)
+			chunk->prev->next = chunk->next;
+		else
+			list->head = chunk->next;
+		if (chunk->next)
+			chunk->next->prev = chunk->prev;
+		else
+			list->tail = chunk->prev;
+		list->allocator->free_(chunk, list->allocator  MEMCALL_VARS);
+	}
+}
+
+LSTDEF void *ulist__get(const ulist_t *list, size_t idx, size_t sz)
+{
+	assert(idx < list->sz);
+	for (ulist__chunk_t *chunk = list->head; chunk; chunk = chunk->next) {
+		const u32 n = chunk->end - chunk->begin;
+		if (idx < n)
+			return ulist__data(chunk) + (chunk->begin + idx) * sz;
+		idx -= n;
+	}
+	return NULL;
+}
+
+LSTDEF void ulist__clear(ulist_t *list  MEMCALL_ARGS)
+{
+	ulist__chunk_t *chunk = list->head;
+	while (chunk) {
+		ulist__chunk_t *next = chunk->next;
+		list->allocator->free_(chunk, list->allocator  MEMCALL_VARS);
+		chunk = next;
+	}
+	list->head = list->tail = NULL;
+	list->sz = 0;
 }
 
 #undef LIST_IMPLEMENTATION
@@ -28,6 +28,10 @@ b32  mkpath(const char *path);
 b32  rmdir_f(const char *path);
 #endif
 
+/* read-only - NULL on failure (or for an empty file) */
+void *file_map(const char *fname, size_t *sz);
+void  file_unmap(void *p, size_t sz);
+
 const char *app_dir(void);
 char *app_data_dir(const char *app_name, allocator_t *a);
 
@@ -48,6 +52,22 @@ b32         lib_close(lib_handle hnd);
 const char *lib_err();
 #endif // VIOLET_NO_LIB
 
+/* Threads - a new thread has to call vlt_init(VLT_THREAD_OTHER) (or
+ * VLT_THREAD_WORKER) before using the temporary allocator or error handling */
+
+#ifdef _WIN32
+typedef HANDLE thread_t;
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+#endif
+
+typedef int (*thread_f)(void *udata);
+
+b32  thread_create(thread_t *thread, thread_f func, void *udata);
+int  thread_join(thread_t thread);
+u32  cpu_count(void);
+
 /* IO */
 
 size_t vgetdelim(char **lineptr, size_t *n, int delim, FILE *stream, allocator_t *a);
@@ -313,6 +333,89 @@ const char *lib_err()
 }
 #endif // VIOLET_NO_LIB
 
+void *file_map(const char *fname, size_t *sz)
+{
+	HANDLE file, mapping;
+	LARGE_INTEGER file_sz;
+	void *p = NULL;
+
+	file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+	                   FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		log_error("failed to open %s", fname);
+		return NULL;
+	}
+	if (GetFileSizeEx(file, &file_sz) && file_sz.QuadPart > 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+	if (!p) {
+		log_error("failed to map %s", fname);
+		return NULL;
+	}
+	*sz = (size_t)file_sz.QuadPart;
+	return p;
+}
+
+void file_unmap(void *p, size_t sz)
+{
+	UnmapViewOfFile(p);
+}
+
+/* Threads */
+
+typedef struct thread__ctx
+{
+	thread_f func;
+	void *udata;
+} thread__ctx_t;
+
+static
+unsigned __stdcall thread__entry(void *arg)
+{
+	const thread__ctx_t ctx = *(thread__ctx_t*)arg;
+	afree(arg, g_allocator);
+	return (unsigned)ctx.func(ctx.udata);
+}
+
+b32 thread_create(thread_t *thread, thread_f func, void *udata)
+{
+	thread__ctx_t *ctx = amalloc(sizeof(thread__ctx_t), g_allocator);
+	if (!ctx) {
+		log_error("failed to create a thread");
+		return false;
+	}
+	ctx->func  = func;
+	ctx->udata = udata;
+	*thread = (HANDLE)_beginthreadex(NULL, 0, thread__entry, ctx, 0, NULL);
+	if (!*thread) {
+		afree(ctx, g_allocator);
+		log_error("failed to create a thread");
+		return false;
+	}
+	return true;
+}
+
+int thread_join(thread_t thread)
+{
+	DWORD ret = 0;
+	WaitForSingleObject(thread, INFINITE);
+	GetExitCodeThread(thread, &ret);
+	CloseHandle(thread);
+	return (int)ret;
+}
+
+u32 cpu_count(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
 b32 open_file_external(const char *filename)
 {
 	const INT_PTR ret = (INT_PTR)ShellExecute(NULL, "open", filename,
@@ -329,8 +432,11 @@ b32 open_file_external(const char *filename)
 
 #include <dlfcn.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -450,6 +556,77 @@ const char *lib_err()
 }
 #endif // VIOLET_NO_LIB
 
+void *file_map(const char *fname, size_t *sz)
+{
+	struct stat st;
+	void *p = MAP_FAILED;
+	const int fd = open(fname, O_RDONLY);
+	if (fd == -1) {
+		log_error("failed to open %s", fname);
+		return NULL;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		log_error("failed to map %s", fname);
+		return NULL;
+	}
+	*sz = st.st_size;
+	return p;
+}
+
+void file_unmap(void *p, size_t sz)
+{
+	munmap(p, sz);
+}
+
+/* Threads */
+
+typedef struct thread__ctx
+{
+	thread_f func;
+	void *udata;
+} thread__ctx_t;
+
+static
+void *thread__entry(void *arg)
+{
+	const thread__ctx_t ctx = *(thread__ctx_t*)arg;
+	afree(arg, g_allocator);
+	return (void*)(intptr_t)ctx.func(ctx.udata);
+}
+
+b32 thread_create(thread_t *thread, thread_f func, void *udata)
+{
+	thread__ctx_t *ctx = amalloc(sizeof(thread__ctx_t), g_allocator);
+	if (!ctx) {
+		log_error("failed to create a thread");
+		return false;
+	}
+	ctx->func  = func;
+	ctx->udata = udata;
+	if (pthread_create(thread, NULL, thread__entry, ctx) != 0) {
+		afree(ctx, g_allocator);
+		log_error("failed to create a thread");
+		return false;
+	}
+	return true;
+}
+
+int thread_join(thread_t thread)
+{
+	void *ret = NULL;
+	pthread_join(thread, &ret);
+	return (int)(intptr_t)ret;
+}
+
+u32 cpu_count(void)
+{
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (u32)n : 1;
+}
+
 b32 open_file_external(const char *filename)
 {
 	char command[256] = "xdg-open ";
@@ -9,17 +9,40 @@
  * shared between multiple allocators. In addition to traditional memory
  * calls, a watermark can be saved & restored as an easy way to free many
  * allocations at once.
+ *
+ * Pages are always a power of two in size, so the heap bins them by size
+ * and can borrow & return pages in constant time. A heap can be capped
+ * to retain at most a given number of bytes - pages returned beyond the
+ * cap are released immediately.
+ *
+ * A heap created with pgb_heap_init_concurrent can be shared by allocators
+ * on different threads. Returning a page is a lock-free push onto its size
+ * bin; borrowing pops under a per-bin spin lock, which rules out ABA and
+ * keeps pages from being freed while another thread is still reading them.
+ *
+ * Pages are aligned to their slot size, so an over-aligned allocation only
+ * needs to skip ahead a few slots.
  */
 
-#define PGB_MIN_PAGE_SIZE 4096
+#define PGB_MIN_PAGE_SIZE      4096
+#define PGB_MIN_PAGE_SIZE_LOG2 12
+#define PGB_HEAP_BIN_COUNT     (sizeof(size_t) * 8 - PGB_MIN_PAGE_SIZE_LOG2)
 
 typedef struct pgb_heap
 {
-	struct pgb_page *first_page;
+	struct pgb_page *bins[PGB_HEAP_BIN_COUNT];
+	u64 nonempty_bins; /* unused when concurrent */
+	spinlock_t bin_locks[PGB_HEAP_BIN_COUNT]; /* only used when concurrent */
+	volatile size_t retained_bytes, retained_pages;
+	size_t max_retained_bytes; /* 0 = unlimited */
+	b32 concurrent;
 } pgb_heap_t;
 
 void pgb_heap_init(pgb_heap_t *heap);
+void pgb_heap_init_concurrent(pgb_heap_t *heap);
 void pgb_heap_destroy(pgb_heap_t *heap);
+void pgb_heap_set_max_retained(pgb_heap_t *heap, size_t max_bytes);
+void pgb_heap_trim(pgb_heap_t *heap, size_t max_bytes);
 
 struct pgb_page *pgb_heap_borrow_page(pgb_heap_t *heap, size_t size);
 void             pgb_heap_return_page(pgb_heap_t *heap, struct pgb_page *page);
@@ -40,6 +63,9 @@ void *pgb_malloc(size_t size, allocator_t *a  MEMCALL_ARGS);
 void *pgb_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS);
 void *pgb_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS);
 void  pgb_free(void *ptr, allocator_t *a  MEMCALL_ARGS);
+void *pgb_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS);
+void *pgb_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                          allocator_t *a  MEMCALL_ARGS);
 
 typedef struct pg_watermark
 {
@@ -112,6 +138,9 @@ typedef union pgb__max_align
 
 static_assert(sizeof(pgb__max_align_t) <= pgb__alignment(PGB_MIN_PAGE_SIZE),
               invalid_word_size_for_pgb_allocator);
+static_assert(PGB_MIN_PAGE_SIZE == 1 << PGB_MIN_PAGE_SIZE_LOG2,
+              invalid_pgb_min_page_size_log2);
+static_assert(PGB_HEAP_BIN_COUNT <= 64, too_many_pgb_heap_bins);
 
 #define pgb__page_alignment(page)   (pgb__alignment((page)->size))
 #define pgb__page_end(page)         (&(page)->start + (page)->size)
@@ -188,6 +217,40 @@ size_t pgb__round_up_power_of_two(size_t x_)
 	return x + 1;
 }
 
+static
+u32 pgb__floor_log2(size_t x)
+{
+#ifndef _WIN32
+	return (u32)(sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(x));
+#elif defined _WIN64
+	unsigned long idx;
+	_BitScanReverse64(&idx, x);
+	return idx;
+#else
+	unsigned long idx;
+	_BitScanReverse(&idx, (unsigned long)x);
+	return idx;
+#endif
+}
+
+static
+u32 pgb__lowest_bit(u64 x)
+{
+#ifndef _WIN32
+	return (u32)__builtin_ctzll(x);
+#elif defined _WIN64
+	unsigned long idx;
+	_BitScanForward64(&idx, x);
+	return idx;
+#else
+	unsigned long idx;
+	if (_BitScanForward(&idx, (unsigned long)x))
+		return idx;
+	_BitScanForward(&idx, (unsigned long)(x >> 32));
+	return idx + 32;
+#endif
+}
+
 static
 size_t pgb__page_min_size_for_alloc(size_t alloc_size)
 {
@@ -213,49 +276,138 @@ void pgb__page_clear(pgb_page_t *page)
 static
 pgb_page_t *pgb__page_create(size_t page_size)
 {
-	pgb_page_t *page = std_malloc(page_size);
+	pgb_page_t *page;
+#ifndef _WIN32
+	if (posix_memalign((void**)&page, pgb__alignment(page_size), page_size) != 0)
+		page = NULL;
+#else
+	page = _aligned_malloc(page_size, pgb__alignment(page_size));
+#endif
+	error_if(!page, "pgb__page_create: oom");
 	page->size = page_size;
 	pgb__page_clear(page);
 	return page;
 }
 
 static
-void pgb__page_remove(pgb_page_t *page)
+void pgb__page_destroy(pgb_page_t *page)
 {
-	if (page->prev)
-		page->prev->next = page->next;
-	if (page->next)
-		page->next->prev = page->prev;
+#ifndef _WIN32
+	std_free(page);
+#else
+	_aligned_free(page);
+#endif
 }
 
 
 /* Heap */
 
+#define pgb__heap_bin_idx(page_size) \
+	(pgb__floor_log2(page_size) - PGB_MIN_PAGE_SIZE_LOG2)
+
 void pgb_heap_init(pgb_heap_t *heap)
 {
-	heap->first_page = NULL;
+	memset(heap, 0, sizeof(pgb_heap_t));
+}
+
+void pgb_heap_init_concurrent(pgb_heap_t *heap)
+{
+	pgb_heap_init(heap);
+	heap->concurrent = true;
 }
 
 void pgb_heap_destroy(pgb_heap_t *heap)
 {
-	pgb_page_t *page = heap->first_page;
-	while (page) {
-		pgb_page_t *next = page->next;
-		std_free(page);
-		page = next;
+	const size_t max_retained_bytes = heap->max_retained_bytes;
+	pgb_heap_trim(heap, 0);
+	heap->max_retained_bytes = max_retained_bytes;
+}
+
+void pgb_heap_set_max_retained(pgb_heap_t *heap, size_t max_bytes)
+{
+	heap->max_retained_bytes = max_bytes;
+	if (max_bytes)
+		pgb_heap_trim(heap, max_bytes);
+}
+
+static
+pgb_page_t *pgb__heap_pop(pgb_heap_t *heap, u32 idx)
+{
+	pgb_page_t *page;
+	if (!heap->concurrent) {
+		page = heap->bins[idx];
+		if (page) {
+			heap->bins[idx] = page->next;
+			if (!page->next)
+				heap->nonempty_bins &= ~((u64)1 << idx);
+			heap->retained_bytes -= page->size;
+			--heap->retained_pages;
+		}
+		return page;
+	}
+
+	if (!vlt_atomic_load_ptr(&heap->bins[idx]))
+		return NULL;
+	/* only one thread pops from a bin at a time, so page->next is stable
+	 * and the page can't be recycled under us - pushes just retry the cas */
+	spinlock_lock(&heap->bin_locks[idx]);
+	page = vlt_atomic_load_ptr(&heap->bins[idx]);
+	while (page && !vlt_atomic_cas_ptr(&heap->bins[idx], &page, page->next))
+		;
+	spinlock_unlock(&heap->bin_locks[idx]);
+	if (page) {
+		vlt_atomic_sub(&heap->retained_bytes, page->size);
+		vlt_atomic_sub(&heap->retained_pages, 1);
+	}
+	return page;
+}
+
+static
+void pgb__heap_push(pgb_heap_t *heap, u32 idx, pgb_page_t *page)
+{
+	page->prev = NULL;
+	if (!heap->concurrent) {
+		page->next = heap->bins[idx];
+		heap->bins[idx] = page;
+		heap->nonempty_bins |= (u64)1 << idx;
+		heap->retained_bytes += page->size;
+		++heap->retained_pages;
+	} else {
+		pgb_page_t *head = vlt_atomic_load_ptr(&heap->bins[idx]);
+		do {
+			page->next = head;
+		} while (!vlt_atomic_cas_ptr(&heap->bins[idx], &head, page));
+		vlt_atomic_add(&heap->retained_bytes, page->size);
+		vlt_atomic_add(&heap->retained_pages, 1);
+	}
+}
+
+void pgb_heap_trim(pgb_heap_t *heap, size_t max_bytes)
+{
+	/* release the largest pages first */
+	for (u32 i = PGB_HEAP_BIN_COUNT;
+	     i > 0 && vlt_atomic_load(&heap->retained_bytes) > max_bytes; --i) {
+		pgb_page_t *page;
+		while (   vlt_atomic_load(&heap->retained_bytes) > max_bytes
+		       && (page = pgb__heap_pop(heap, i-1)))
+			pgb__page_destroy(page);
 	}
-	heap->first_page = NULL;
 }
 
 struct pgb_page *pgb_heap_borrow_page(pgb_heap_t *heap, size_t size)
 {
-	pgb_page_t *page = heap->first_page;
-	while (page && page->size < size)
-		page = page->next;
+	const u32 min_idx = pgb__heap_bin_idx(size);
+	pgb_page_t *page = NULL;
+	assert(size == (size_t)1 << pgb__floor_log2(size));
+	if (!heap->concurrent) {
+		const u64 bins = heap->nonempty_bins & (~(u64)0 << min_idx);
+		if (bins)
+			page = pgb__heap_pop(heap, pgb__lowest_bit(bins));
+	} else {
+		for (u32 i = min_idx; i < PGB_HEAP_BIN_COUNT && !page; ++i)
+			page = pgb__heap_pop(heap, i);
+	}
 	if (page) {
-		if (page == heap->first_page)
-			heap->first_page = page->next;
-		pgb__page_remove(page);
 		pgb__page_clear(page);
 		return page;
 	} else {
@@ -265,23 +417,12 @@ struct pgb_page *pgb_heap_borrow_page(pgb_heap_t *heap, size_t size)
 
 void pgb_heap_return_page(pgb_heap_t *heap, struct pgb_page *page)
 {
-	if (heap->first_page) {
-		pgb_page_t *prev = heap->first_page;
-		pgb_page_t *next = heap->first_page->next;
-		while (next && page->size > next->size) {
-			prev = next;
-			next = next->next;
-		}
-		if (next)
-			next->prev = page;
-		prev->next = page;
-		page->prev = prev;
-		page->next = next;
-	} else {
-		heap->first_page = page;
-		page->prev = NULL;
-		page->next = NULL;
-	}
+	if (   heap->max_retained_bytes
+	    &&   vlt_atomic_load(&heap->retained_bytes) + page->size
+	       > heap->max_retained_bytes)
+		pgb__page_destroy(page);
+	else
+		pgb__heap_push(heap, pgb__heap_bin_idx(page->size), page);
 }
 
 /* Allocator */
@@ -416,15 +557,69 @@ void pgb_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
 	} else if (pgb__ptr_in_page(ptr, pgb->current_page)) {
 		pgb__alloc_set_sz(ptr, pgb->current_page, 0);
 #ifdef VLT_ANALYZE_TEMP_MEMORY
-		log_warn("pgb_free: cannot recapture memory @ %s", loc);
+		log_warn("pgb_free: cannot recapture memory @ %s", MEMCALL_LOC);
 #endif
 	}
 #ifdef VLT_ANALYZE_TEMP_MEMORY
 	else
-		log_warn("pgb_free: cannot recapture memory @ %s", loc);
+		log_warn("pgb_free: cannot recapture memory @ %s", MEMCALL_LOC);
 #endif
 }
 
+static
+b32 pgb__pad_to_alignment(pgb_t *pgb, size_t size, size_t alignment)
+{
+	pgb_page_t *page = pgb->current_page;
+	pgb_byte *ptr;
+	if (!page)
+		return false;
+	ptr = (pgb_byte*)pgb__align((size_t)pgb->current_ptr, alignment);
+	if (ptr + pgb__page_align(size, page) > pgb__page_end(page))
+		return false;
+	pgb->current_ptr = ptr;
+	return true;
+}
+
+void *pgb_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS)
+{
+	pgb_t *pgb = a->udata;
+	size_t aligned_size;
+	if (size == 0)
+		return NULL;
+	if (!pgb__pad_to_alignment(pgb, size, alignment)) {
+		pgb__add_page_for_alloc(pgb, size + alignment, &aligned_size);
+		pgb__pad_to_alignment(pgb, size, alignment);
+	}
+	return pgb_malloc(size, a  MEMCALL_VARS);
+}
+
+void *pgb_realloc_aligned(void *ptr_, size_t size, size_t alignment,
+                          allocator_t *a  MEMCALL_ARGS)
+{
+	pgb_byte *ptr = ptr_, *new_ptr;
+	pgb_t *pgb = a->udata;
+	const pgb_page_t *page;
+	size_t old_size;
+	if (!ptr)
+		return pgb_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	if (!size)
+		return pgb_realloc(ptr, size, a  MEMCALL_VARS);
+	/* resizing the last allocation in place keeps its alignment */
+	if (   ((size_t)ptr & (alignment - 1)) == 0
+	    && pgb__ptr_is_last_alloc(ptr, pgb)
+	    &&    ptr + pgb__page_align(size, pgb->current_page)
+	       <= pgb__page_end(pgb->current_page))
+		return pgb_realloc(ptr, size, a  MEMCALL_VARS);
+	page = pgb->current_page;
+	while (page && !pgb__ptr_in_page(ptr, page))
+		page = page->prev;
+	error_if(!page, "could not find page for allocation");
+	old_size = pgb__alloc_get_sz(ptr, page);
+	new_ptr = pgb_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+	return new_ptr;
+}
+
 pgb_watermark_t pgb_save(pgb_t *pgb)
 {
 	return (pgb_watermark_t) {
@@ -471,14 +666,8 @@ void pgb_stats(const pgb_t *pgb, size_t *bytes_used, size_t *pages_used,
 		page = page->prev;
 	}
 
-	*bytes_available = 0;
-	*pages_available = 0;
-	page = pgb->heap->first_page;
-	while (page) {
-		*bytes_available += page->size;
-		++*pages_available;
-		page = page->next;
-	}
+	*bytes_available = vlt_atomic_load(&pgb->heap->retained_bytes);
+	*pages_available = vlt_atomic_load(&pgb->heap->retained_pages);
 }
 
 #undef PGB_IMPLEMENTATION
@@ -0,0 +1,444 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+ * POOL allocator
+ *
+ * A size-class allocator that carves fixed size objects out of large,
+ * aligned slabs. Each size class keeps separate lists of its partially used
+ * and full slabs, so malloc & free are O(1) and never fragment. Allocations
+ * larger than the biggest size class get a dedicated slab, which is released
+ * as soon as the allocation is freed.
+ */
+
+#ifndef POOL_SLAB_SIZE
+#define POOL_SLAB_SIZE 65536
+#endif
+
+#define POOL_MAX_CLASS_SIZE 8192
+#define POOL_CLASS_COUNT    32
+#define POOL_MAX_ALIGNMENT  64
+
+typedef struct pool_class
+{
+	struct pool_slab *partial_slabs, *full_slabs;
+	size_t slab_cnt, empty_slab_cnt;
+	size_t objs_used, objs_capacity;
+} pool_class_t;
+
+typedef struct pool
+{
+	pool_class_t classes[POOL_CLASS_COUNT];
+	struct pool_slab *large_slabs;
+	size_t large_bytes, large_cnt;
+} pool_t;
+
+void pool_init(pool_t *pool);
+void pool_destroy(pool_t *pool);
+
+void *pool_malloc(size_t size, allocator_t *a  MEMCALL_ARGS);
+void *pool_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS);
+void *pool_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS);
+void  pool_free(void *ptr, allocator_t *a  MEMCALL_ARGS);
+/* alignments up to POOL_MAX_ALIGNMENT only */
+void *pool_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS);
+void *pool_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                           allocator_t *a  MEMCALL_ARGS);
+
+size_t pool_class_size(u32 class_idx);
+void   pool_class_stats(const pool_t *pool, u32 class_idx,
+                        size_t *objs_used, size_t *objs_capacity,
+                        size_t *slabs);
+void   pool_stats(const pool_t *pool, size_t *bytes_used, size_t *slabs_used,
+                  size_t *bytes_available, size_t *large_bytes);
+
+#endif // POOL_H
+
+
+
+/* Implementation */
+#ifdef POOL_IMPLEMENTATION
+
+/*
+ * Size classes are multiples of 16 up to 128, then 4 classes per power of two
+ * (160, 192, 224, 256, 320, ...) up to POOL_MAX_CLASS_SIZE, which keeps the
+ * internal waste of any allocation under 25%.
+ */
+
+#define POOL__CLASS_LARGE  POOL_CLASS_COUNT
+#define POOL__SLAB_MASK    (~((uintptr_t)POOL_SLAB_SIZE - 1))
+
+static_assert((POOL_SLAB_SIZE & (POOL_SLAB_SIZE - 1)) == 0,
+              pool_slab_size_must_be_a_power_of_two);
+static_assert(POOL_SLAB_SIZE >= 8 * POOL_MAX_CLASS_SIZE,
+              pool_slab_size_too_small_for_max_class_size);
+
+typedef uint8_t pool_byte;
+
+typedef struct pool_slab
+{
+	union
+	{
+		struct
+		{
+			struct pool_slab *prev, *next;
+			void *free_list;
+			pool_byte *bump;
+			size_t size;
+			u32 class_idx, used;
+		};
+		pool_byte header[64];
+	};
+	pool_byte first_obj;
+} pool_slab_t;
+
+static_assert(offsetof(pool_slab_t, first_obj) == POOL_MAX_ALIGNMENT,
+              invalid_pool_slab_header_size);
+
+#define pool__slab_first_obj(slab) (&(slab)->first_obj)
+#define pool__slab_end(slab)       ((pool_byte*)(slab) + (slab)->size)
+#define pool__slab_of(ptr)         ((pool_slab_t*)((uintptr_t)(ptr) & POOL__SLAB_MASK))
+
+static
+u32 pool__floor_log2(size_t x)
+{
+#ifndef _WIN32
+	return (u32)(sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(x));
+#elif defined _WIN64
+	unsigned long idx;
+	_BitScanReverse64(&idx, x);
+	return idx;
+#else
+	unsigned long idx;
+	_BitScanReverse(&idx, (unsigned long)x);
+	return idx;
+#endif
+}
+
+static
+u32 pool__class_idx(size_t size)
+{
+	u32 b;
+	if (size <= 128)
+		return size == 0 ? 0 : (u32)((size + 15) / 16 - 1);
+	b = pool__floor_log2(size - 1);
+	return 8 + (b - 7) * 4 + (u32)((size - 1) >> (b - 2)) - 4;
+}
+
+size_t pool_class_size(u32 class_idx)
+{
+	assert(class_idx < POOL_CLASS_COUNT);
+	if (class_idx < 8) {
+		return (class_idx + 1) * 16;
+	} else {
+		const u32 group = (class_idx - 8) / 4, step = (class_idx - 8) % 4;
+		return ((size_t)128 << group) + (step + 1) * ((size_t)32 << group);
+	}
+}
+
+static
+pool_slab_t *pool__slab_create(size_t size, u32 class_idx)
+{
+	pool_slab_t *slab;
+#ifndef _WIN32
+	if (posix_memalign((void**)&slab, POOL_SLAB_SIZE, size) != 0)
+		slab = NULL;
+#else
+	slab = _aligned_malloc(size, POOL_SLAB_SIZE);
+#endif
+	error_if(!slab, "pool__slab_create: oom");
+	slab->prev      = NULL;
+	slab->next      = NULL;
+	slab->free_list = NULL;
+	slab->bump      = pool__slab_first_obj(slab);
+	slab->size      = size;
+	slab->class_idx = class_idx;
+	slab->used      = 0;
+	return slab;
+}
+
+static
+void pool__slab_destroy(pool_slab_t *slab)
+{
+#ifndef _WIN32
+	std_free(slab);
+#else
+	_aligned_free(slab);
+#endif
+}
+
+static
+void pool__slab_unlink(pool_slab_t **list, pool_slab_t *slab)
+{
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		*list = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+	slab->prev = NULL;
+	slab->next = NULL;
+}
+
+static
+void pool__slab_push_front(pool_slab_t **list, pool_slab_t *slab)
+{
+	slab->prev = NULL;
+	slab->next = *list;
+	if (*list)
+		(*list)->prev = slab;
+	*list = slab;
+}
+
+static
+b32 pool__slab_full(const pool_slab_t *slab, size_t obj_size)
+{
+	return !slab->free_list && slab->bump + obj_size > pool__slab_end(slab);
+}
+
+static
+size_t pool__slab_capacity(size_t obj_size)
+{
+	return (POOL_SLAB_SIZE - offsetof(pool_slab_t, first_obj)) / obj_size;
+}
+
+static
+void pool__slab_list_destroy(pool_slab_t *slab)
+{
+	while (slab) {
+		pool_slab_t *next = slab->next;
+		pool__slab_destroy(slab);
+		slab = next;
+	}
+}
+
+void pool_init(pool_t *pool)
+{
+	memset(pool, 0, sizeof(pool_t));
+}
+
+void pool_destroy(pool_t *pool)
+{
+	for (u32 i = 0; i < POOL_CLASS_COUNT; ++i) {
+		pool__slab_list_destroy(pool->classes[i].partial_slabs);
+		pool__slab_list_destroy(pool->classes[i].full_slabs);
+	}
+	pool__slab_list_destroy(pool->large_slabs);
+	pool_init(pool);
+}
+
+static
+void *pool__malloc_large(pool_t *pool, size_t size)
+{
+	pool_slab_t *slab = pool__slab_create(offsetof(pool_slab_t, first_obj) + size,
+	                                      POOL__CLASS_LARGE);
+	slab->used = 1;
+	pool__slab_push_front(&pool->large_slabs, slab);
+	pool->large_bytes += size;
+	++pool->large_cnt;
+	return pool__slab_first_obj(slab);
+}
+
+void *pool_malloc(size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	pool_t *pool = a->udata;
+	pool_class_t *class;
+	pool_slab_t *slab;
+	size_t obj_size;
+	void *ptr;
+	u32 class_idx;
+
+	if (size == 0)
+		return NULL;
+	if (size > POOL_MAX_CLASS_SIZE) {
+		log_alloc("pool", size  MEMCALL_VARS);
+		return pool__malloc_large(pool, size);
+	}
+
+	class_idx = pool__class_idx(size);
+	class = &pool->classes[class_idx];
+	obj_size = pool_class_size(class_idx);
+	slab = class->partial_slabs;
+	if (!slab) {
+		slab = pool__slab_create(POOL_SLAB_SIZE, class_idx);
+		pool__slab_push_front(&class->partial_slabs, slab);
+		++class->slab_cnt;
+		class->objs_capacity += pool__slab_capacity(obj_size);
+	} else if (slab->used == 0) {
+		--class->empty_slab_cnt;
+	}
+
+	if (slab->free_list) {
+		ptr = slab->free_list;
+		slab->free_list = *(void**)ptr;
+	} else {
+		ptr = slab->bump;
+		slab->bump += obj_size;
+	}
+	++slab->used;
+	++class->objs_used;
+
+	if (pool__slab_full(slab, obj_size)) {
+		pool__slab_unlink(&class->partial_slabs, slab);
+		pool__slab_push_front(&class->full_slabs, slab);
+	}
+
+	log_alloc("pool", obj_size  MEMCALL_VARS);
+	return ptr;
+}
+
+void *pool_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	void *ptr = pool_malloc(nmemb * size, a  MEMCALL_VARS);
+	if (ptr)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+static
+size_t pool__alloc_size(const void *ptr)
+{
+	const pool_slab_t *slab = pool__slab_of(ptr);
+	return slab->class_idx == POOL__CLASS_LARGE
+	     ? slab->size - offsetof(pool_slab_t, first_obj)
+	     : pool_class_size(slab->class_idx);
+}
+
+void *pool_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	if (ptr) {
+		if (size) {
+			const size_t old_size = pool__alloc_size(ptr);
+			void *new_ptr;
+			/* large blocks only shrink in place while they stay over half used */
+			if (old_size > POOL_MAX_CLASS_SIZE
+			    ? size <= old_size && size > old_size / 2 && size > POOL_MAX_CLASS_SIZE
+			    : size <= POOL_MAX_CLASS_SIZE
+			      && pool__class_idx(size) == pool__slab_of(ptr)->class_idx)
+				return ptr;
+			new_ptr = pool_malloc(size, a  MEMCALL_VARS);
+			if (!new_ptr)
+				return NULL;
+			memcpy(new_ptr, ptr, size < old_size ? size : old_size);
+			pool_free(ptr, a  MEMCALL_VARS);
+			return new_ptr;
+		} else {
+			pool_free(ptr, a  MEMCALL_VARS);
+			return NULL;
+		}
+	} else if (size) {
+		return pool_malloc(size, a  MEMCALL_VARS);
+	} else {
+		return NULL;
+	}
+}
+
+void *pool_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS)
+{
+	/* Objects are packed from POOL_MAX_ALIGNMENT bytes into a slab, so any
+	 * class whose size is a multiple of the alignment keeps it. */
+	if (alignment > POOL_MAX_ALIGNMENT) {
+		log_error("pool_malloc_aligned: alignment %lu not supported", alignment);
+		return NULL;
+	}
+	if (size > 0 && size <= POOL_MAX_CLASS_SIZE) {
+		u32 class_idx = pool__class_idx(size);
+		while (pool_class_size(class_idx) % alignment != 0)
+			++class_idx;
+		size = pool_class_size(class_idx);
+	}
+	return pool_malloc(size, a  MEMCALL_VARS);
+}
+
+void *pool_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                           allocator_t *a  MEMCALL_ARGS)
+{
+	size_t old_size;
+	void *new_ptr;
+	if (!ptr)
+		return pool_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	if (!size)
+		return pool_realloc(ptr, size, a  MEMCALL_VARS);
+	old_size = pool__alloc_size(ptr);
+	if (   ((uintptr_t)ptr & (alignment - 1)) == 0
+	    && size <= old_size && size > old_size / 2)
+		return ptr;
+	new_ptr = pool_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	if (new_ptr) {
+		memcpy(new_ptr, ptr, size < old_size ? size : old_size);
+		pool_free(ptr, a  MEMCALL_VARS);
+	}
+	return new_ptr;
+}
+
+void pool_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
+{
+	pool_t *pool = a->udata;
+	pool_slab_t *slab;
+	pool_class_t *class;
+	size_t obj_size;
+
+	if (!ptr)
+		return;
+
+	slab = pool__slab_of(ptr);
+	if (slab->class_idx == POOL__CLASS_LARGE) {
+		pool->large_bytes -= slab->size - offsetof(pool_slab_t, first_obj);
+		--pool->large_cnt;
+		pool__slab_unlink(&pool->large_slabs, slab);
+		pool__slab_destroy(slab);
+		return;
+	}
+
+	class = &pool->classes[slab->class_idx];
+	obj_size = pool_class_size(slab->class_idx);
+	if (pool__slab_full(slab, obj_size)) {
+		pool__slab_unlink(&class->full_slabs, slab);
+		pool__slab_push_front(&class->partial_slabs, slab);
+	}
+	*(void**)ptr = slab->free_list;
+	slab->free_list = ptr;
+	--slab->used;
+	--class->objs_used;
+
+	if (slab->used == 0) {
+		/* keep one empty slab per class around to avoid thrashing */
+		if (class->empty_slab_cnt > 0) {
+			pool__slab_unlink(&class->partial_slabs, slab);
+			pool__slab_destroy(slab);
+			--class->slab_cnt;
+			class->objs_capacity -= pool__slab_capacity(obj_size);
+		} else {
+			++class->empty_slab_cnt;
+		}
+	}
+}
+
+void pool_class_stats(const pool_t *pool, u32 class_idx,
+                      size_t *objs_used, size_t *objs_capacity, size_t *slabs)
+{
+	const pool_class_t *class = &pool->classes[class_idx];
+	assert(class_idx < POOL_CLASS_COUNT);
+	*objs_used     = class->objs_used;
+	*objs_capacity = class->objs_capacity;
+	*slabs         = class->slab_cnt;
+}
+
+void pool_stats(const pool_t *pool, size_t *bytes_used, size_t *slabs_used,
+                size_t *bytes_available, size_t *large_bytes)
+{
+	*bytes_used = 0;
+	*slabs_used = 0;
+	*bytes_available = 0;
+	for (u32 i = 0; i < POOL_CLASS_COUNT; ++i) {
+		const size_t obj_size = pool_class_size(i);
+		*bytes_used      += pool->classes[i].objs_used * obj_size;
+		*bytes_available +=   (pool->classes[i].objs_capacity - pool->classes[i].objs_used)
+		                    * obj_size;
+		*slabs_used      += pool->classes[i].slab_cnt;
+	}
+	*large_bytes = pool->large_bytes;
+}
+
+#undef POOL_IMPLEMENTATION
+#endif // POOL_IMPLEMENTATION
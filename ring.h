@@ -0,0 +1,199 @@
+#ifndef VIOLET_RING_H
+#define VIOLET_RING_H
+
+/*
+ * Ring buffer / double-ended queue.
+ *
+ * Elements live in a power of two sized buffer indexed by free-running
+ * 32-bit head & tail counters, so pushing & popping at either end is O(1)
+ * and wrapping is a mask. Bulk operations copy at most two contiguous spans.
+ *
+ * A ring either owns its buffer & grows on demand, or is initialized over a
+ * caller-provided buffer with ring_init_fixed - it then never allocates and
+ * pushes fail (returning false/NULL) once it is full.
+ *
+ * Elements are passed by address (as lvalues) and copied bytewise.
+ * Pointers into the ring are valid until the next push.
+ */
+
+#ifdef RING_STATIC
+#define RINGDEF static
+#else
+#define RINGDEF
+#endif
+
+#if defined RING_STATIC && !defined RING_IMPLEMENTATION
+#define RING_IMPLEMENTATION
+#endif
+
+typedef struct ring
+{
+	void *data;
+	u32 head, tail;
+	u32 cap, elem_sz;
+	allocator_t *allocator; /* NULL = fixed capacity */
+} ring_t;
+
+#define ring(type) ring_t
+
+#define ring_init(r, type)            ring_init_ex(r, type, g_allocator)
+#define ring_init_ex(r, type, alc)    ring__init(&(r), NULL, 0, sizeof(type), alc)
+/* buf is an array whose length is a power of two */
+#define ring_init_fixed(r, buf)       ring__init(&(r), buf, countof(buf), sizeof((buf)[0]), \
+                                                 NULL)
+#define ring_destroy(r)               ring__destroy(&(r)  MEMCALL_LOCATION)
+
+#define ring_sz(r)                    ((r).tail - (r).head)
+#define ring_cap(r)                   ((r).cap)
+#define ring_empty(r)                 ((r).tail == (r).head)
+#define ring_full(r)                  (ring_sz(r) == (r).cap)
+#define ring_reserve(r, n)            ring__reserve(&(r), n  MEMCALL_LOCATION)
+#define ring_clear(r)                 ((r).head = (r).tail = 0)
+
+/* i counts from the front */
+#define ring_at(r, i)                 ((void*)(  (u8*)(r).data \
+                                               + (((r).head + (i)) & ((r).cap - 1)) \
+                                                 * (r).elem_sz))
+#define ring_front(r)                 ring_at(r, 0)
+#define ring_back(r)                  ring_at(r, ring_sz(r) - 1)
+#define ring_iterate(r, it, n)        for (u32 it = 0, n = ring_sz(r); it < n; ++it)
+
+#define ring_push_back_null(r)        ring__push_null(&(r), false  MEMCALL_LOCATION)
+#define ring_push_front_null(r)       ring__push_null(&(r), true  MEMCALL_LOCATION)
+#define ring_push_back(r, e)          ring__push(&(r), &(e), false  MEMCALL_LOCATION)
+#define ring_push_front(r, e)         ring__push(&(r), &(e), true  MEMCALL_LOCATION)
+/* dst may be NULL - returns false if the ring was empty */
+#define ring_pop_front(r, dst)        ring__pop(&(r), dst, true)
+#define ring_pop_back(r, dst)         ring__pop(&(r), dst, false)
+/* all or nothing - returns false if a fixed ring can't hold n more elements */
+#define ring_push_back_n(r, src, n)   ring__push_back_n(&(r), src, n  MEMCALL_LOCATION)
+/* dst may be NULL - returns the number of elements popped */
+#define ring_pop_front_n(r, dst, n)   ring__pop_front_n(&(r), dst, n)
+
+
+RINGDEF void  ring__init(ring_t *r, void *buf, u32 cap, size_t elem_sz, allocator_t *a);
+RINGDEF void  ring__destroy(ring_t *r  MEMCALL_ARGS);
+RINGDEF b32   ring__reserve(ring_t *r, u32 n  MEMCALL_ARGS);
+RINGDEF void *ring__push_null(ring_t *r, b32 front  MEMCALL_ARGS);
+RINGDEF b32   ring__push(ring_t *r, const void *elem, b32 front  MEMCALL_ARGS);
+RINGDEF b32   ring__pop(ring_t *r, void *dst, b32 front);
+RINGDEF b32   ring__push_back_n(ring_t *r, const void *src, u32 n  MEMCALL_ARGS);
+RINGDEF u32   ring__pop_front_n(ring_t *r, void *dst, u32 n);
+
+#endif // VIOLET_RING_H
+
+#ifdef RING_IMPLEMENTATION
+
+#define RING__MIN_CAP 16
+
+#define ring__slot(r, i) ((u8*)(r)->data + ((i) & ((r)->cap - 1)) * (r)->elem_sz)
+
+RINGDEF void ring__init(ring_t *r, void *buf, u32 cap, size_t elem_sz, allocator_t *a)
+{
+	assert((cap & (cap - 1)) == 0);
+	assert(buf || a);
+	r->data      = buf;
+	r->head      = 0;
+	r->tail      = 0;
+	r->cap       = cap;
+	r->elem_sz   = (u32)elem_sz;
+	r->allocator = a;
+}
+
+RINGDEF void ring__destroy(ring_t *r  MEMCALL_ARGS)
+{
+	if (r->allocator && r->data)
+		r->allocator->free_(r->data, r->allocator  MEMCALL_VARS);
+	r->data = NULL;
+	r->head = r->tail = r->cap = 0;
+}
+
+RINGDEF b32 ring__reserve(ring_t *r, u32 n  MEMCALL_ARGS)
+{
+	const u32 old_cap = r->cap;
+	const u32 sz = ring_sz(*r);
+	u32 cap = old_cap ? old_cap : RING__MIN_CAP;
+	u8 *data;
+	if (n <= old_cap)
+		return true;
+	if (!r->allocator)
+		return false;
+	while (cap < n)
+		cap *= 2;
+	data = r->allocator->realloc_(r->data, (size_t)cap * r->elem_sz,
+	                              r->allocator  MEMCALL_VARS);
+	error_if(!data, "ring__reserve: oom");
+	/* the wrapped part [0, tail) has to follow [head, old_cap) again */
+	if (old_cap) {
+		const u32 h = r->head & (old_cap - 1);
+		const u32 t = r->tail & (old_cap - 1);
+		if (sz && t <= h)
+			memcpy(data + (size_t)old_cap * r->elem_sz, data, (size_t)t * r->elem_sz);
+		r->head = h;
+		r->tail = h + sz;
+	}
+	r->data = data;
+	r->cap = cap;
+	return true;
+}
+
+RINGDEF void *ring__push_null(ring_t *r, b32 front  MEMCALL_ARGS)
+{
+	if (   ring_sz(*r) == r->cap
+	    && !ring__reserve(r, r->cap ? r->cap * 2 : RING__MIN_CAP  MEMCALL_VARS))
+		return NULL;
+	return front ? ring__slot(r, --r->head) : ring__slot(r, r->tail++);
+}
+
+RINGDEF b32 ring__push(ring_t *r, const void *elem, b32 front  MEMCALL_ARGS)
+{
+	void *slot = ring__push_null(r, front  MEMCALL_VARS);
+	if (slot)
+		memcpy(slot, elem, r->elem_sz);
+	return slot != NULL;
+}
+
+RINGDEF b32 ring__pop(ring_t *r, void *dst, b32 front)
+{
+	const void *slot;
+	if (ring_empty(*r))
+		return false;
+	slot = front ? ring__slot(r, r->head++) : ring__slot(r, --r->tail);
+	if (dst)
+		memcpy(dst, slot, r->elem_sz);
+	return true;
+}
+
+RINGDEF b32 ring__push_back_n(ring_t *r, const void *src, u32 n  MEMCALL_ARGS)
+{
+	u32 t, n0;
+	if (!n)
+		return true;
+	if (!ring__reserve(r, ring_sz(*r) + n  MEMCALL_VARS))
+		return false;
+	t  = r->tail & (r->cap - 1);
+	n0 = r->cap - t < n ? r->cap - t : n;
+	memcpy(ring__slot(r, t), src, (size_t)n0 * r->elem_sz);
+	memcpy(r->data, (const u8*)src + (size_t)n0 * r->elem_sz,
+	       (size_t)(n - n0) * r->elem_sz);
+	r->tail += n;
+	return true;
+}
+
+RINGDEF u32 ring__pop_front_n(ring_t *r, void *dst, u32 n)
+{
+	if (n > ring_sz(*r))
+		n = ring_sz(*r);
+	if (dst && n) {
+		const u32 h  = r->head & (r->cap - 1);
+		const u32 n0 = r->cap - h < n ? r->cap - h : n;
+		memcpy(dst, ring__slot(r, h), (size_t)n0 * r->elem_sz);
+		memcpy((u8*)dst + (size_t)n0 * r->elem_sz, r->data,
+		       (size_t)(n - n0) * r->elem_sz);
+	}
+	r->head += n;
+	return n;
+}
+
+#undef RING_IMPLEMENTATION
+#endif // RING_IMPLEMENTATION
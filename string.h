@@ -1,21 +1,47 @@
 #ifndef VIOLET_STRING_H
 #define VIOLET_STRING_H
 
+#include <math.h>
+
 /* C strings */
 char *strtrim(char *str);
+/* with thousands separators, truncated to n - 1 chars */
 char *sprint_u32(char *buf, u32 n, u32 val);
 char *sprint_s32(char *buf, u32 n, s32 val);
 char *sprint_r32(char *buf, u32 n, r32 val, u32 dec);
 
-/* Immediate strings - single string buffer for immediate use.
+/* Number formatting - single pass, without going through printf.
+ * Each writes a '\0'-terminated string & returns its length. sep is inserted
+ * between groups of 3 integer digits, or 0 for none.
+ * fmt_r64_fixed rounds like printf's "%.*f" (to nearest, ties to even) &
+ * likewise keeps the '-' of a negative value that rounds to zero.
+ * fmt_r32/fmt_r64 write the fewest digits that read back as exactly val
+ * (with strtof/strtod), using an exponent only for very large/small values. */
+#define FMT_INT_SZ  28
+#define FMT_REAL_SZ 32
+
+u32 fmt_u64(char *buf, u64 val, char sep);
+u32 fmt_s64(char *buf, s64 val, char sep);
+u32 fmt_r64_fixed(char *buf, u32 n, r64 val, u32 dec, char sep);
+u32 fmt_r32(char *buf, r32 val);
+u32 fmt_r64(char *buf, r64 val);
+
+/* Immediate strings - small per-thread string buffers for immediate use.
+ * Every imprint/imstrcpy/imstrcat2 call writes to the next of
+ * IMPRINT_BUFFER_COUNT rotating buffers, so that many results stay valid
+ * together, and imstr/imstrcat refer to the most recent one.
  * Be very careful when writing functions that take a string as a parameter
- * and use this string - assert(str != imstr()) is recommended.
+ * and use these buffers - assert(str != imstr()) is recommended.
  *
  * The default is long enough for most OS's max file path length. */
 #ifndef IMPRINT_BUFFER_SIZE
 #define IMPRINT_BUFFER_SIZE 4096
 #endif
 
+#ifndef IMPRINT_BUFFER_COUNT
+#define IMPRINT_BUFFER_COUNT 4
+#endif
+
 char *imstr(void);
 char *imprint_u32(u32 val);
 char *imprint_s32(s32 val);
@@ -26,16 +52,25 @@ char *imstrcat(const char *src);
 char *imstrcatn(char *imstr, const char *src); /* for chaining imprint calls */
 char *imstrcat2(const char *src1, const char *src2); /* for 2 new strings */
 
-/* Dynamic strings - array(char) */
+/* Dynamic strings - array(char)
+ * array_sz is the length, excluding the terminating '\0' that always follows.
+ * Appending grows the capacity geometrically & never rescans the string. */
 #define str_t array(char)
 
-#define str_create(allocator) array_create_ex(allocator)
+#define str_create(allocator) str__create(allocator  MEMCALL_LOCATION)
 #define str_destroy(str)      array_destroy(str)
+#define str_len(str)          array_sz(str)
+#define str_clear(str)        (array_sz(str) = 0, (str)[0] = '\0')
 
+str_t str__create(allocator_t *a  MEMCALL_ARGS);
 void str_cpy(str_t *dst, const char *src);
 void str_cat(str_t *dst, const char *src);
+void str_cat_n(str_t *dst, const char *src, size_t n);
+void str_cat_char(str_t *dst, char c);
 void str_cat2(str_t *dst, const char *src1, const char *src2);
 void str_catw(str_t *dst, const char *src);
+void str_catf(str_t *dst, const char *fmt, ...);
+void str_vcatf(str_t *dst, const char *fmt, va_list args);
 
 #endif // VIOLET_STRING_H
 
@@ -52,144 +87,462 @@ char *strtrim(char *str)
 	return str;
 }
 
+static const char g_fmt__digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* writes the digits of val backwards, ending at end - returns the start */
 static
-void sprint__separators(char *buf, size_t sep_off, size_t sep_cnt, size_t len)
+char *fmt__u64_rev(char *end, u64 val, char sep)
 {
-	for (size_t i = 0; i < sep_cnt; ++i) {
-		const size_t sep_pos = sep_off + i * 4;
-		memmove(buf + sep_pos + 1, buf + sep_pos, len + sep_cnt - sep_pos);
-		buf[sep_pos] = ',';
+	char *p = end;
+	if (sep) {
+		while (val >= 1000) {
+			const u32 group = (u32)(val % 1000);
+			val /= 1000;
+			p -= 2;
+			memcpy(p, &g_fmt__digit_pairs[(group % 100) * 2], 2);
+			*--p = '0' + group / 100;
+			*--p = sep;
+		}
 	}
+	while (val >= 100) {
+		p -= 2;
+		memcpy(p, &g_fmt__digit_pairs[(val % 100) * 2], 2);
+		val /= 100;
+	}
+	if (val >= 10) {
+		p -= 2;
+		memcpy(p, &g_fmt__digit_pairs[val * 2], 2);
+	} else {
+		*--p = '0' + (char)val;
+	}
+	return p;
 }
 
-char *sprint_u32(char *buf, u32 n, u32 val)
+static
+u32 fmt__signed(char *buf, b32 neg, u64 mag, char sep)
 {
-	size_t len, sep_cnt, sep_off;
+	char tmp[FMT_INT_SZ];
+	char *p = fmt__u64_rev(tmp + sizeof(tmp), mag, sep);
+	u32 len = (u32)(tmp + sizeof(tmp) - p);
+	if (neg)
+		*buf++ = '-';
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+	return len + (neg ? 1 : 0);
+}
 
-	snprintf(buf, n, "%u", val);
-	len = strlen(buf);
-	sep_cnt = (len - 1) / 3;
-	sep_off = ((len - 1) % 3) + 1;
+u32 fmt_u64(char *buf, u64 val, char sep)
+{
+	return fmt__signed(buf, false, val, sep);
+}
 
-	if (sep_cnt > 0)
-		sprint__separators(buf, sep_off, sep_cnt, len);
-	return buf;
+u32 fmt_s64(char *buf, s64 val, char sep)
+{
+	return fmt__signed(buf, val < 0, val < 0 ? 0 - (u64)val : (u64)val, sep);
 }
 
-char *sprint_s32(char *buf, u32 n, s32 val)
+static
+r64 fmt__pow10(s32 k)
 {
-	size_t len, sep_cnt, sep_off;
+	static const r64 exact[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+	};
+	r64 p = 1;
+	if (k < 0)
+		return 1 / fmt__pow10(-k);
+	for (; k > 22; k -= 22)
+		p *= exact[22];
+	return p * exact[k];
+}
 
-	snprintf(buf, n, "%d", val);
-	len = strlen(buf);
-	sep_cnt = (len - 1) / 3;
-	sep_off = ((len - 1) % 3) + 1;
+/* nan, inf & zero - returns 0 for any other value */
+static
+u32 fmt__special(char *buf, r64 val)
+{
+	u64 bits;
+	const char *str;
+	memcpy(&bits, &val, sizeof(bits));
+	if ((bits & 0x7ff0000000000000ull) == 0x7ff0000000000000ull)
+		str = (bits & 0x000fffffffffffffull) ? "nan" : (bits >> 63) ? "-inf" : "inf";
+	else if ((bits << 1) == 0)
+		str = (bits >> 63) ? "-0" : "0";
+	else
+		return 0;
+	strcpy(buf, str);
+	return (u32)strlen(str);
+}
 
-	if (sep_cnt > 0)
-		sprint__separators(buf, sep_off, sep_cnt, len);
-	return buf;
+static
+u32 fmt__fixed_big(char *buf, u32 n, b32 neg, r64 mag, u32 dec, char sep)
+{
+	/* beyond u64 range - rare enough to leave the digits to the C runtime.
+	 * At most 309 integer digits, the point & 19 decimals. */
+	char digits[330];
+	const int digits_len = snprintf(digits, sizeof(digits), "%.*f", (int)dec, mag);
+	const u32 int_len = (u32)digits_len - (dec ? dec + 1 : 0);
+	u32 len = 0;
+	if (neg && len + 1 < n)
+		buf[len++] = '-';
+	for (u32 i = 0; i < (u32)digits_len && len + 1 < n; ++i) {
+		if (sep && i > 0 && i < int_len && (int_len - i) % 3 == 0) {
+			buf[len++] = sep;
+			if (len + 1 == n)
+				break;
+		}
+		buf[len++] = digits[i];
+	}
+	buf[len] = '\0';
+	return len;
 }
 
-char *sprint_r32(char *buf, u32 n, r32 val, u32 dec)
+/* rounds mag * scale (< 2^64) to the nearest integer, ties to even.
+ * The product is rounded once already, so its exact error decides ties
+ * & the carry instead of rounding the rounded product again. */
+static
+u64 fmt__round_scaled(r64 mag, r64 scale)
 {
-	size_t len, sep_cnt, sep_off;
+	const r64 prod = mag * scale;
+	u64 i = (u64)prod;
+	if (prod < 4503599627370496.0) {
+		/* below 2^52, prod - i is exact & only a tie needs the error */
+		const r64 frac = prod - (r64)i;
+		if (frac > 0.5) {
+			++i;
+		} else if (frac == 0.5) {
+			const r64 err = fma(mag, scale, -prod);
+			if (err > 0 || (err == 0 && (i & 1)))
+				++i;
+		}
+	} else {
+		/* prod is integral & the error may be several units */
+		const r64 err = fma(mag, scale, -prod);
+		s64 k = (s64)err;
+		r64 frac;
+		if ((r64)k > err)
+			--k;
+		frac = err - (r64)k;
+		i += (u64)k;
+		if (frac > 0.5 || (frac == 0.5 && (i & 1)))
+			++i;
+	}
+	return i;
+}
 
-	assert(dec >= 0 && dec < 9);
+u32 fmt_r64_fixed(char *buf, u32 n, r64 val, u32 dec, char sep)
+{
+	/* like printf, keep the sign of negatives (& -0) that round to zero */
+	const b32 neg = signbit(val) != 0;
+	const r64 mag = neg ? -val : val;
+	char tmp[FMT_INT_SZ + 20];
+	char *p = tmp + sizeof(tmp);
+	u32 len;
+
+	assert(dec < 20 && n > 0);
+
+	if (mag < 1.8e19 / fmt__pow10(dec)) {
+		const u64 scale  = (u64)fmt__pow10(dec);
+		const u64 scaled = fmt__round_scaled(mag, (r64)scale);
+		if (dec) {
+			u64 frac = scaled % scale;
+			for (u32 i = 0; i < dec; ++i, frac /= 10)
+				*--p = '0' + (char)(frac % 10);
+			*--p = '.';
+		}
+		p = fmt__u64_rev(p, scaled / scale, sep);
+		if (neg)
+			*--p = '-';
+		len = (u32)(tmp + sizeof(tmp) - p);
+	} else if ((len = fmt__special(tmp, val)) != 0) {
+		p = tmp;
+	} else {
+		return fmt__fixed_big(buf, n, neg, mag, dec, sep);
+	}
 
-	snprintf(buf, n, "%.0f", val);
-	len = strlen(buf);
-	sep_cnt = (len - 1) / 3;
-	sep_off = ((len - 1) % 3) + 1;
+	len = len < n ? len : n - 1;
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+	return len;
+}
 
-	assert(len + sep_cnt < n);
+/* lays out the significant digits d (with d[0] != '0') of a number
+ * d[0].d[1..] * 10^e10 */
+static
+u32 fmt__real(char *buf, b32 neg, const char *d, u32 nd, s32 e10)
+{
+	char *p = buf;
+	if (neg)
+		*p++ = '-';
+	if (e10 >= 21 || e10 < -7) {
+		*p++ = d[0];
+		if (nd > 1) {
+			*p++ = '.';
+			memcpy(p, d + 1, nd - 1);
+			p += nd - 1;
+		}
+		*p++ = 'e';
+		if (e10 < 0) {
+			*p++ = '-';
+			e10 = -e10;
+		}
+		p += fmt_u64(p, (u64)e10, 0);
+	} else if (e10 < 0) {
+		*p++ = '0';
+		*p++ = '.';
+		for (s32 i = -1; i > e10; --i)
+			*p++ = '0';
+		memcpy(p, d, nd);
+		p += nd;
+	} else if ((u32)e10 + 1 >= nd) {
+		memcpy(p, d, nd);
+		p += nd;
+		for (u32 i = nd; i <= (u32)e10; ++i)
+			*p++ = '0';
+	} else {
+		memcpy(p, d, e10 + 1);
+		p += e10 + 1;
+		*p++ = '.';
+		memcpy(p, d + e10 + 1, nd - e10 - 1);
+		p += nd - e10 - 1;
+	}
+	*p = '\0';
+	return (u32)(p - buf);
+}
 
-	{
-		char fmt[8] = "%.xf";
-		fmt[2] = '0' + dec;
-		snprintf(buf, n, fmt, val);
+u32 fmt_r32(char *buf, r32 val)
+{
+	/* r64 has ample precision to scale & round-trip test r32 candidates */
+	const b32 neg = val < 0;
+	const r64 mag = neg ? -(r64)val : (r64)val;
+	const r32 target = neg ? -val : val;
+	char digits[FMT_INT_SZ];
+	u64 bits, m = 0;
+	s32 e10;
+	u32 nd, len;
+
+	if ((len = fmt__special(buf, val)) != 0)
+		return len;
+
+	/* estimate the decimal exponent from the binary one, then correct it */
+	memcpy(&bits, &mag, sizeof(bits));
+	e10 = (s32)((((s32)(bits >> 52) - 1023) * 78913) >> 18);
+	while (mag * fmt__pow10(-e10) >= 10)
+		++e10;
+	while (mag * fmt__pow10(-e10) < 1)
+		--e10;
+
+	for (nd = 1; nd <= 9; ++nd) {
+		const s32 k = (s32)nd - 1 - e10;
+		m = (u64)(mag * fmt__pow10(k) + 0.5);
+		if (m >= (u64)fmt__pow10(nd)) {
+			/* rounded up to the next power of 10 */
+			++e10;
+			--nd;
+			continue;
+		}
+		if ((r32)(k >= 0 ? m / fmt__pow10(k) : m * fmt__pow10(-k)) == target)
+			break;
 	}
+	assert(nd <= 9);
 
-	if (sep_cnt > 0)
-		sprint__separators(buf, sep_off, sep_cnt, len);
+	for (u32 i = nd; i > 0; --i, m /= 10)
+		digits[i-1] = '0' + (char)(m % 10);
+	while (nd > 1 && digits[nd-1] == '0')
+		--nd;
+	return fmt__real(buf, neg, digits, nd, e10);
+}
+
+u32 fmt_r64(char *buf, r64 val)
+{
+	/* r64 candidates can't be checked exactly with r64 arithmetic, so the
+	 * C runtime's correctly rounded conversions do the digit search */
+	char tmp[FMT_REAL_SZ], digits[FMT_REAL_SZ];
+	const b32 neg = val < 0;
+	u32 nd = 0, len;
+	s32 e10;
+
+	if ((len = fmt__special(buf, val)) != 0)
+		return len;
+
+	for (int prec = 15; prec <= 17; ++prec) {
+		snprintf(tmp, sizeof(tmp), "%.*e", prec - 1, val);
+		if (prec == 17 || strtod(tmp, NULL) == val)
+			break;
+	}
+
+	for (const char *c = tmp + neg; *c != 'e'; ++c)
+		if (*c != '.')
+			digits[nd++] = *c;
+	while (nd > 1 && digits[nd-1] == '0')
+		--nd;
+	e10 = (s32)strtol(strchr(tmp, 'e') + 1, NULL, 10);
+	return fmt__real(buf, neg, digits, nd, e10);
+}
+
+static
+char *sprint__int(char *buf, u32 n, b32 neg, u64 mag)
+{
+	char tmp[FMT_INT_SZ];
+	const u32 len = fmt__signed(tmp, neg, mag, ',');
+	if (n) {
+		const u32 max_len = n - 1 < sizeof(tmp) - 1 ? n - 1 : sizeof(tmp) - 1;
+		const u32 cpy_len = len < max_len ? len : max_len;
+		memcpy(buf, tmp, cpy_len);
+		buf[cpy_len] = '\0';
+	}
 	return buf;
 }
 
-static char g_imprint_buf[IMPRINT_BUFFER_SIZE] = {0};
+char *sprint_u32(char *buf, u32 n, u32 val)
+{
+	return sprint__int(buf, n, false, val);
+}
+
+char *sprint_s32(char *buf, u32 n, s32 val)
+{
+	return sprint__int(buf, n, val < 0, val < 0 ? 0 - (u64)val : (u64)val);
+}
+
+char *sprint_r32(char *buf, u32 n, r32 val, u32 dec)
+{
+	assert(dec < 9);
+	fmt_r64_fixed(buf, n, val, dec, ',');
+	return buf;
+}
+
+static thread_local char g_imprint_bufs[IMPRINT_BUFFER_COUNT][IMPRINT_BUFFER_SIZE];
+static thread_local u32 g_imprint_idx = 0;
+
+/* claims the next buffer in the rotation */
+static
+char *imstr__next(void)
+{
+	g_imprint_idx = (g_imprint_idx + 1) % IMPRINT_BUFFER_COUNT;
+	g_imprint_bufs[g_imprint_idx][0] = '\0';
+	return g_imprint_bufs[g_imprint_idx];
+}
+
+#ifndef NDEBUG
+static
+b32 imstr__owns(const char *str)
+{
+	return    str >= g_imprint_bufs[0]
+	       && str <  g_imprint_bufs[IMPRINT_BUFFER_COUNT-1] + IMPRINT_BUFFER_SIZE;
+}
+#endif
 
 char *imstr(void)
 {
-	return g_imprint_buf;
+	return g_imprint_bufs[g_imprint_idx];
 }
 
 char *imprint_u32(u32 val)
 {
-	return sprint_u32(B2PC(g_imprint_buf), val);
+	return sprint_u32(imstr__next(), IMPRINT_BUFFER_SIZE, val);
 }
 
 char *imprint_s32(s32 val)
 {
-	return sprint_s32(B2PC(g_imprint_buf), val);
+	return sprint_s32(imstr__next(), IMPRINT_BUFFER_SIZE, val);
 }
 
 char *imprint_r32(r32 val, u32 dec)
 {
-	return sprint_r32(B2PC(g_imprint_buf), val, dec);
+	return sprint_r32(imstr__next(), IMPRINT_BUFFER_SIZE, val, dec);
 }
 
 char *imprintf(const char *fmt, ...)
 {
+	char *buf = imstr__next();
 	va_list args;
 	va_start(args, fmt);
-	vsnprintf(g_imprint_buf, IMPRINT_BUFFER_SIZE, fmt, args);
+	vsnprintf(buf, IMPRINT_BUFFER_SIZE, fmt, args);
 	va_end(args);
-	return g_imprint_buf;
+	return buf;
 }
 
 char *imstrcpy(const char *str)
 {
-	strncpy(g_imprint_buf, str, IMPRINT_BUFFER_SIZE);
-	return g_imprint_buf;
+	char *buf = imstr__next();
+	strncpy(buf, str, IMPRINT_BUFFER_SIZE - 1);
+	buf[IMPRINT_BUFFER_SIZE-1] = '\0';
+	return buf;
 }
 
 char *imstrcat(const char *src)
 {
-	return strncat(imstr(), src, IMPRINT_BUFFER_SIZE-strlen(imstr())-1);
+	return imstrcatn(imstr(), src);
 }
 
 char *imstrcatn(char *imstr, const char *src)
 {
-	assert(imstr == g_imprint_buf);
-	return imstrcat(src);
+	assert(imstr__owns(imstr));
+	return strncat(imstr, src, IMPRINT_BUFFER_SIZE-strlen(imstr)-1);
 }
 
 char *imstrcat2(const char *src1, const char *src2)
 {
 	assert(strlen(src1) < IMPRINT_BUFFER_SIZE);
-	imstrcpy(src1);
-	return strncat(g_imprint_buf, src2, IMPRINT_BUFFER_SIZE-strlen(src1)-1);
+	return imstrcatn(imstrcpy(src1), src2);
+}
+
+#define STR__MIN_CAP 16
+
+/* makes room for n more chars & the terminator */
+#define str__reserve_more(dst, n) \
+	(*(dst) = array__grow_n(*(dst), (array_size_t)(n) + 1, 1  MEMCALL_LOCATION))
+
+str_t str__create(allocator_t *a  MEMCALL_ARGS)
+{
+	str_t str = array__create(STR__MIN_CAP, 1, a  MEMCALL_VARS);
+	str[0] = '\0';
+	return str;
 }
 
 void str_cpy(str_t *dst, const char *src)
 {
-	array_reserve(*dst, (array_size_t)(strlen(src) + 1));
-	strcpy(*dst, src);
+	array_clear(*dst);
+	str_cat(dst, src);
 }
 
 void str_cat(str_t *dst, const char *src)
 {
-	const size_t sz = array_sz(*dst);
-	array_reserve(*dst, (array_size_t)(sz + strlen(src) + 1));
-	strcat(&(*dst)[sz], src);
+	str_cat_n(dst, src, strlen(src));
+}
+
+void str_cat_n(str_t *dst, const char *src, size_t n)
+{
+	assert(src < *dst || src >= *dst + array_cap(*dst));
+	str__reserve_more(dst, n);
+	memcpy(array_end(*dst), src, n);
+	array_sz(*dst) += (array_size_t)n;
+	(*dst)[array_sz(*dst)] = '\0';
+}
+
+void str_cat_char(str_t *dst, char c)
+{
+	str__reserve_more(dst, 1);
+	(*dst)[array_sz(*dst)++] = c;
+	(*dst)[array_sz(*dst)] = '\0';
 }
 
 void str_cat2(str_t *dst, const char *src1, const char *src2)
 {
-	const size_t dsz = array_sz(*dst);
 	const size_t sz1 = strlen(src1);
 	const size_t sz2 = strlen(src2);
-	array_reserve(*dst, (array_size_t)(dsz + sz1 + sz2 + 1));
-	strcat(&(*dst)[dsz], src1);
-	strcat(&(*dst)[dsz+sz1], src2);
+	str__reserve_more(dst, sz1 + sz2);
+	str_cat_n(dst, src1, sz1);
+	str_cat_n(dst, src2, sz2);
 }
 
 void str_catw(str_t *dst, const char *src)
@@ -197,4 +550,33 @@ void str_catw(str_t *dst, const char *src)
 	str_cat2(dst, " ", src);
 }
 
-#endif
+void str_catf(str_t *dst, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	str_vcatf(dst, fmt, args);
+	va_end(args);
+}
+
+void str_vcatf(str_t *dst, const char *fmt, va_list args)
+{
+	/* format straight into the spare capacity - only retry if it didn't fit */
+	const array_size_t sz = array_sz(*dst);
+	va_list args2;
+	int n;
+	va_copy(args2, args);
+	n = vsnprintf(array_end(*dst), array_cap(*dst) - sz, fmt, args);
+	if (n < 0) {
+		(*dst)[sz] = '\0';
+	} else {
+		if ((array_size_t)n >= array_cap(*dst) - sz) {
+			str__reserve_more(dst, n);
+			vsnprintf(array_end(*dst), (size_t)n + 1, fmt, args2);
+		}
+		array_sz(*dst) = sz + (array_size_t)n;
+	}
+	va_end(args2);
+}
+
+#undef STRING_IMPLEMENTATION
+#endif // STRING_IMPLEMENTATION
@@ -0,0 +1,320 @@
+#ifndef VMB_H
+#define VMB_H
+
+/*
+ * Virtual Memory Bump allocator
+ *
+ * A bump allocator over a single contiguous range of reserved address space.
+ * Physical memory is committed in VMB_COMMIT_SIZE chunks as the bump pointer
+ * advances, so the arena never has to move or be split into pages. Growing
+ * the most recent allocation is done in place, and restoring a watermark is
+ * just a pointer reset.
+ *
+ * Every allocation is preceded by a small header linking it to the previous
+ * allocation, so the last allocation can always be freed or resized, even
+ * after the one following it has been freed.
+ */
+
+#ifndef VMB_RESERVE_SIZE
+#if INTPTR_MAX == INT64_MAX
+#define VMB_RESERVE_SIZE ((size_t)1 << 34)
+#else
+#define VMB_RESERVE_SIZE ((size_t)1 << 28)
+#endif
+#endif
+
+#ifndef VMB_COMMIT_SIZE
+#define VMB_COMMIT_SIZE 65536
+#endif
+
+typedef uint8_t vmb_byte;
+typedef struct vmb
+{
+	vmb_byte *base, *current_ptr, *commit_end, *reserve_end;
+	struct vmb__header *last;
+} vmb_t;
+
+void vmb_init(vmb_t *vmb, size_t reserve_size);
+void vmb_destroy(vmb_t *vmb);
+void vmb_decommit_unused(vmb_t *vmb);
+
+void *vmb_malloc(size_t size, allocator_t *a  MEMCALL_ARGS);
+void *vmb_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS);
+void *vmb_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS);
+void  vmb_free(void *ptr, allocator_t *a  MEMCALL_ARGS);
+void *vmb_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS);
+void *vmb_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                          allocator_t *a  MEMCALL_ARGS);
+
+typedef struct vmb_watermark
+{
+	struct vmb *vmb;
+	vmb_byte *ptr;
+	struct vmb__header *last;
+} vmb_watermark_t;
+
+vmb_watermark_t vmb_save(vmb_t *vmb);
+void            vmb_restore(vmb_watermark_t watermark);
+
+void vmb_stats(const vmb_t *vmb, size_t *bytes_used, size_t *bytes_committed,
+               size_t *bytes_reserved);
+
+#endif // VMB_H
+
+
+
+/* Implementation */
+#ifdef VMB_IMPLEMENTATION
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#define VMB__ALIGNMENT 16
+
+typedef struct vmb__header
+{
+	union
+	{
+		struct
+		{
+			struct vmb__header *prev;
+			size_t size;
+		};
+		vmb_byte align[VMB__ALIGNMENT];
+	};
+} vmb__header_t;
+
+static_assert(sizeof(vmb__header_t) == VMB__ALIGNMENT, invalid_vmb_header_size);
+
+static
+size_t vmb__align(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static
+vmb_byte *vmb__reserve(size_t size)
+{
+#ifndef _WIN32
+	void *p = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+	               -1, 0);
+	return p != MAP_FAILED ? p : NULL;
+#else
+	return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#endif
+}
+
+static
+void vmb__release(vmb_byte *base, size_t size)
+{
+#ifndef _WIN32
+	munmap(base, size);
+#else
+	VirtualFree(base, 0, MEM_RELEASE);
+#endif
+}
+
+static
+b32 vmb__commit(vmb_byte *p, size_t size)
+{
+#ifndef _WIN32
+	return mprotect(p, size, PROT_READ | PROT_WRITE) == 0;
+#else
+	return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#endif
+}
+
+static
+void vmb__decommit(vmb_byte *p, size_t size)
+{
+#ifndef _WIN32
+	madvise(p, size, MADV_DONTNEED);
+	mprotect(p, size, PROT_NONE);
+#else
+	VirtualFree(p, size, MEM_DECOMMIT);
+#endif
+}
+
+void vmb_init(vmb_t *vmb, size_t reserve_size)
+{
+	reserve_size = vmb__align(reserve_size, VMB_COMMIT_SIZE);
+	vmb->base        = vmb__reserve(reserve_size);
+	error_if(!vmb->base, "vmb_init: failed to reserve address space");
+	vmb->current_ptr = vmb->base;
+	vmb->commit_end  = vmb->base;
+	vmb->reserve_end = vmb->base + reserve_size;
+	vmb->last        = NULL;
+}
+
+void vmb_destroy(vmb_t *vmb)
+{
+	if (vmb->base)
+		vmb__release(vmb->base, vmb->reserve_end - vmb->base);
+	memset(vmb, 0, sizeof(vmb_t));
+}
+
+void vmb_decommit_unused(vmb_t *vmb)
+{
+	vmb_byte *keep = vmb->base + vmb__align(vmb->current_ptr - vmb->base,
+	                                        VMB_COMMIT_SIZE);
+	if (keep < vmb->commit_end) {
+		vmb__decommit(keep, vmb->commit_end - keep);
+		vmb->commit_end = keep;
+	}
+}
+
+static
+b32 vmb__ensure_committed(vmb_t *vmb, const vmb_byte *end)
+{
+	if (end <= vmb->commit_end)
+		return true;
+	if (end > vmb->reserve_end) {
+		log_error("vmb: reserved address space exhausted");
+		return false;
+	} else {
+		vmb_byte *commit_end = vmb->base + vmb__align(end - vmb->base, VMB_COMMIT_SIZE);
+		if (!vmb__commit(vmb->commit_end, commit_end - vmb->commit_end)) {
+			log_error("vmb: failed to commit memory");
+			return false;
+		}
+		vmb->commit_end = commit_end;
+		return true;
+	}
+}
+
+#define vmb__header_of(ptr) ((vmb__header_t*)(ptr) - 1)
+
+void *vmb_malloc(size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	vmb_t *vmb = a->udata;
+	const size_t aligned_size = vmb__align(size, VMB__ALIGNMENT);
+	vmb__header_t *header;
+	if (size == 0)
+		return NULL;
+	header = (vmb__header_t*)vmb->current_ptr;
+	if (!vmb__ensure_committed(vmb, (vmb_byte*)(header + 1) + aligned_size))
+		return NULL;
+	header->prev = vmb->last;
+	header->size = aligned_size;
+	vmb->last = header;
+	vmb->current_ptr = (vmb_byte*)(header + 1) + aligned_size;
+	log_alloc("vmb", aligned_size  MEMCALL_VARS);
+	return header + 1;
+}
+
+void *vmb_calloc(size_t nmemb, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	void *ptr = vmb_malloc(nmemb * size, a  MEMCALL_VARS);
+	if (ptr)
+		memset(ptr, 0, nmemb * size);
+	return ptr;
+}
+
+void *vmb_realloc(void *ptr, size_t size, allocator_t *a  MEMCALL_ARGS)
+{
+	vmb_t *vmb = a->udata;
+	if (ptr) {
+		if (size) {
+			vmb__header_t *header = vmb__header_of(ptr);
+			const size_t aligned_size = vmb__align(size, VMB__ALIGNMENT);
+			if (header == vmb->last) {
+				if (!vmb__ensure_committed(vmb, (vmb_byte*)ptr + aligned_size))
+					return NULL;
+				header->size = aligned_size;
+				vmb->current_ptr = (vmb_byte*)ptr + aligned_size;
+				return ptr;
+			} else if (aligned_size <= header->size) {
+				return ptr;
+			} else {
+				void *new_ptr = vmb_malloc(size, a  MEMCALL_VARS);
+				if (new_ptr)
+					memcpy(new_ptr, ptr, header->size);
+				return new_ptr;
+			}
+		} else {
+			vmb_free(ptr, a  MEMCALL_VARS);
+			return NULL;
+		}
+	} else if (size) {
+		return vmb_malloc(size, a  MEMCALL_VARS);
+	} else {
+		return NULL;
+	}
+}
+
+void vmb_free(void *ptr, allocator_t *a  MEMCALL_ARGS)
+{
+	vmb_t *vmb = a->udata;
+	if (!ptr)
+		return;
+	if (vmb__header_of(ptr) == vmb->last) {
+		vmb->current_ptr = (vmb_byte*)vmb->last;
+		vmb->last = vmb->last->prev;
+	}
+#ifdef VLT_ANALYZE_TEMP_MEMORY
+	else
+		log_warn("vmb_free: cannot recapture memory @ %s", MEMCALL_LOC);
+#endif
+}
+
+void *vmb_malloc_aligned(size_t size, size_t alignment, allocator_t *a  MEMCALL_ARGS)
+{
+	/* pad before the header, so the header stays right in front of ptr */
+	vmb_t *vmb = a->udata;
+	vmb_byte *prev_ptr = vmb->current_ptr;
+	void *ptr;
+	vmb->current_ptr = (vmb_byte*)vmb__align((size_t)(prev_ptr + sizeof(vmb__header_t)),
+	                                         alignment) - sizeof(vmb__header_t);
+	ptr = vmb_malloc(size, a  MEMCALL_VARS);
+	if (!ptr)
+		vmb->current_ptr = prev_ptr;
+	return ptr;
+}
+
+void *vmb_realloc_aligned(void *ptr, size_t size, size_t alignment,
+                          allocator_t *a  MEMCALL_ARGS)
+{
+	vmb_t *vmb = a->udata;
+	void *new_ptr;
+	if (!ptr)
+		return vmb_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	/* the last allocation is resized in place, so it keeps its alignment */
+	if (   !size
+	    || (   ((size_t)ptr & (alignment - 1)) == 0
+	        && (   vmb__header_of(ptr) == vmb->last
+	            || vmb__align(size, VMB__ALIGNMENT) <= vmb__header_of(ptr)->size)))
+		return vmb_realloc(ptr, size, a  MEMCALL_VARS);
+	new_ptr = vmb_malloc_aligned(size, alignment, a  MEMCALL_VARS);
+	if (new_ptr) {
+		const size_t old_size = vmb__header_of(ptr)->size;
+		memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+	}
+	return new_ptr;
+}
+
+vmb_watermark_t vmb_save(vmb_t *vmb)
+{
+	return (vmb_watermark_t) {
+		.vmb  = vmb,
+		.ptr  = vmb->current_ptr,
+		.last = vmb->last,
+	};
+}
+
+void vmb_restore(vmb_watermark_t watermark)
+{
+	watermark.vmb->current_ptr = watermark.ptr;
+	watermark.vmb->last        = watermark.last;
+}
+
+void vmb_stats(const vmb_t *vmb, size_t *bytes_used, size_t *bytes_committed,
+               size_t *bytes_reserved)
+{
+	*bytes_used      = vmb->current_ptr - vmb->base;
+	*bytes_committed = vmb->commit_end - vmb->base;
+	*bytes_reserved  = vmb->reserve_end - vmb->base;
+}
+
+#undef VMB_IMPLEMENTATION
+#endif // VMB_IMPLEMENTATION
@@ -2,10 +2,169 @@
 #define VIOLET_VSON_H
 
 #include "violet/core.h"
+#include "violet/array.h"
+#include "violet/hashmap.h"
+#include "violet/atom.h"
+#include "violet/fmath.h"
+#include "violet/string.h"
+#include "violet/os.h"
 
 #define VSON_LABEL_SZ 32
 #define VSON_VALUE_SZ 64
 
+/*
+ * Every value is a labelled record, read back in the order it was written.
+ * There are 2 encodings:
+ *   VSON_TEXT   - "label: value" lines, for diffing & debugging
+ *   VSON_BINARY - tagged records with fixed-width little-endian payloads
+ *                 and labels replaced by ids, after a magic number
+ * vson_reader_t reads both (detected from the magic number), and
+ * vson_writer_t writes either, so only the writer needs to pick one.
+ * The FILE based vson_read_* & vson_write_* only handle text.
+ */
+typedef enum vson_format
+{
+	VSON_TEXT,
+	VSON_BINARY,
+} vson_format_t;
+
+/* Arrays of reals are a single record - a count, then the values, in text
+ * either as shortest round-trip decimals or as base64 of their raw bytes.
+ * Binary always stores the raw bytes. v2f arrays are stored as 2n reals.
+ * Longer arrays than VSON_ARRAY_MAX_N reals aren't written, which keeps the
+ * size of every record within a u32. */
+#define VSON_ARRAY_MAX_N (1u << 26)
+
+typedef enum vson_array_encoding
+{
+	VSON_ARRAY_DECIMAL,
+	VSON_ARRAY_BASE64,
+} vson_array_encoding_t;
+
+/* Structs are described by a table with a vson_field_t per member, in the
+ * order they are written, and read & written by walking it. Labels are
+ * matched by a hash computed at compile time. Members can be absent from
+ * the input as long as the ones present keep the table order - absent
+ * members keep their value. The struct ends at the first record that isn't
+ * one of the members still to come, which is left unread. */
+typedef enum vson_field_type
+{
+	VSON_FIELD_B8,
+	VSON_FIELD_B32,
+	VSON_FIELD_U8,
+	VSON_FIELD_S8,
+	VSON_FIELD_U16,
+	VSON_FIELD_S16,
+	VSON_FIELD_U32,
+	VSON_FIELD_S32,
+	VSON_FIELD_R32,
+	VSON_FIELD_R64,
+	VSON_FIELD_STR, /* char array */
+} vson_field_type_t;
+
+typedef struct vson_field
+{
+	const char *label;
+	u32 hash, len;
+	u32 offset;
+	u16 type, sz;
+} vson_field_t;
+
+/* label has to be a string literal, e.g.
+ * vson_field(item_t, pos.x, R32, "x") */
+#define vson_field(s, member, type_, label_) \
+	{ .label = label_, .hash = hash_lit(label_), .len = sizeof(label_) - 1, \
+	  .offset = offsetof(s, member), .type = VSON_FIELD_##type_, \
+	  .sz = sizeof(((s*)0)->member) }
+
+typedef struct vson__label
+{
+	const char *str;
+	u32 len;
+	u32 hash; /* binary only */
+} vson__label_t;
+
+typedef struct vson__section
+{
+	vson__label_t label;
+	u64 offset;
+} vson__section_t;
+
+/* Reader over a byte span - labels are matched & numbers parsed in place.
+ * The span needn't be '\0'-terminated, so it can be a mapped file. */
+typedef struct vson_reader
+{
+	const char *p, *end;
+	const char *begin;                 /* at document offset base */
+	u64 base;
+	const char *index, *index_end;     /* header index trailer, if any */
+	char *owned;
+	allocator_t *allocator;
+	vson_format_t format;
+	b32 labels_indexed;                /* labels came from the index */
+	array(vson__label_t) labels;       /* binary only */
+	array(vson__section_t) sections;   /* parsed from the index on demand */
+} vson_reader_t;
+
+void vson_reader_init(vson_reader_t *r, const void *buf, size_t sz);
+/* reads the entire file into memory from a */
+b32  vson_reader_load(vson_reader_t *r, const char *fname, allocator_t *a);
+b32  vson_reader_load_fp(vson_reader_t *r, FILE *fp, allocator_t *a);
+/* reads only the index & the section starting with header label, and leaves
+ * the reader before that header - fp has to be seekable */
+b32  vson_reader_load_section(vson_reader_t *r, FILE *fp, const char *label,
+                              allocator_t *a);
+void vson_reader_destroy(vson_reader_t *r);
+
+/* Positions the reader before the first header labelled label, so the next
+ * read is vson_get_header(r, label). Needs a document written with
+ * vson_writer_index_headers. */
+b32  vson_seek_header(vson_reader_t *r, const char *label);
+
+b32  vson_get_header(vson_reader_t *r, const char *label);
+b32  vson_get_b8(vson_reader_t *r, const char *label, b8 *val);
+b32  vson_get_u8(vson_reader_t *r, const char *label, u8 *val);
+b32  vson_get_s8(vson_reader_t *r, const char *label, s8 *val);
+b32  vson_get_u16(vson_reader_t *r, const char *label, u16 *val);
+b32  vson_get_s16(vson_reader_t *r, const char *label, s16 *val);
+b32  vson_get_b32(vson_reader_t *r, const char *label, b32 *val);
+b32  vson_get_s32(vson_reader_t *r, const char *label, s32 *val);
+b32  vson_get_u32(vson_reader_t *r, const char *label, u32 *val);
+#define vson_get_enum(r, label, val) vson_get_u32(r, label, (u32*)(val))
+b32  vson_get_r32(vson_reader_t *r, const char *label, r32 *val);
+b32  vson_get_r64(vson_reader_t *r, const char *label, r64 *val);
+/* copies at most sz - 1 chars - fails if the value didn't fit */
+b32  vson_get_str(vson_reader_t *r, const char *label, char *val, u32 sz);
+/* points into the span instead of copying - the value isn't '\0'-terminated */
+b32  vson_get_str_view(vson_reader_t *r, const char *label, const char **val,
+                       u32 *len);
+/* fails if there are more than cap values */
+b32  vson_get_r32_array(vson_reader_t *r, const char *label, r32 *vals, u32 cap,
+                        u32 *n);
+b32  vson_get_v2f_array(vson_reader_t *r, const char *label, v2f *vals, u32 cap,
+                        u32 *n);
+b32  vson_get_struct(vson_reader_t *r, void *s, const vson_field_t *fields, u32 n);
+
+/* Parallel loading - maps fname, splits it before every header labelled
+ * label & runs load on each section, on up to n_threads threads (0 = one per
+ * cpu, including the calling thread). load gets a reader over one section,
+ * positioned before its header, and that section's slot in results (an
+ * array, which grows by one zeroed element per section, in file order).
+ * Records before the first such header are skipped. Sections are found from
+ * the header index if the document has one. Every thread has its own
+ * temporary allocator, which is reset after each section. The reader is
+ * borrowed - load mustn't destroy it or seek. A corrupt binary document or
+ * index fails before any section is loaded. */
+typedef b32 (*vson_section_f)(vson_reader_t *r, void *result, void *udata);
+
+#define vson_load_sections(fname, label, load, results, udata, n_threads) \
+	vson__load_sections(fname, label, load, (void**)&(results), \
+	                    sizeof(*(results)), udata, n_threads)
+b32  vson__load_sections(const char *fname, const char *label, vson_section_f load,
+                         void **results, size_t result_sz, void *udata,
+                         u32 n_threads);
+
+/* Stream API - reads a line at a time & parses it with a vson_reader_t */
 b32  vson_read_header(FILE *fp, const char *label);
 b32  vson_read_b8(FILE *fp, const char *label, b8 *val);
 b32  vson_read_u8(FILE *fp, const char *label, u8 *val);
@@ -19,6 +178,9 @@ b32  vson_read_u32(FILE *fp, const char *label, u32 *val);
 b32  vson_read_r32(FILE *fp, const char *label, r32 *val);
 b32  vson_read_r64(FILE *fp, const char *label, r64 *val);
 b32  vson_read_str(FILE *fp, const char *label, char *val, u32 sz);
+b32  vson_read_r32_array(FILE *fp, const char *label, r32 *vals, u32 cap, u32 *n);
+b32  vson_read_v2f_array(FILE *fp, const char *label, v2f *vals, u32 cap, u32 *n);
+b32  vson_read_struct(FILE *fp, void *s, const vson_field_t *fields, u32 n);
 void vson_write_header(FILE *fp, const char *label);
 void vson_write_b32(FILE *fp, const char *label, b32 val);
 void vson_write_s32(FILE *fp, const char *label, s32 val);
@@ -26,6 +188,61 @@ void vson_write_u32(FILE *fp, const char *label, u32 val);
 void vson_write_r32(FILE *fp, const char *label, r32 val);
 void vson_write_r64(FILE *fp, const char *label, r64 val);
 void vson_write_str(FILE *fp, const char *label, const char *val);
+void vson_write_r32_array(FILE *fp, const char *label, const r32 *vals, u32 n,
+                          vson_array_encoding_t enc);
+void vson_write_v2f_array(FILE *fp, const char *label, const v2f *vals, u32 n,
+                          vson_array_encoding_t enc);
+void vson_write_struct(FILE *fp, const void *s, const vson_field_t *fields, u32 n);
+
+/* Writer - records are formatted into a memory buffer, which is handed to
+ * fwrite whenever it reaches VSON_WRITER_FLUSH_SZ, and when flushed or
+ * destroyed. Without a FILE, everything stays in the buffer. */
+#ifndef VSON_WRITER_FLUSH_SZ
+#define VSON_WRITER_FLUSH_SZ (1 << 20)
+#endif
+
+typedef struct vson__index_entry
+{
+	atom_t label;
+	u64 offset;
+} vson__index_entry_t;
+
+typedef struct vson_writer
+{
+	FILE *fp;
+	vson_format_t format;
+	array(char) buf;
+	u64 flushed;                       /* bytes handed to fwrite so far */
+	atom_table_t labels;               /* binary label id = atom - 1 */
+	array(vson__index_entry_t) index;  /* NULL unless indexing headers */
+} vson_writer_t;
+
+void vson_writer_init(vson_writer_t *w, FILE *fp, vson_format_t format);
+void vson_writer_init_ex(vson_writer_t *w, FILE *fp, vson_format_t format,
+                         allocator_t *a);
+/* returns false if writing to the file failed */
+b32  vson_writer_flush(vson_writer_t *w);
+/* writes the index trailer before the final flush */
+b32  vson_writer_destroy(vson_writer_t *w);
+/* records the offset of every following header, so the document can be read
+ * with vson_seek_header & vson_reader_load_section */
+void vson_writer_index_headers(vson_writer_t *w);
+#define vson_writer_data(w) ((w)->buf)
+#define vson_writer_sz(w)   array_sz((w)->buf)
+
+void vson_put_header(vson_writer_t *w, const char *label);
+void vson_put_b32(vson_writer_t *w, const char *label, b32 val);
+void vson_put_s32(vson_writer_t *w, const char *label, s32 val);
+void vson_put_u32(vson_writer_t *w, const char *label, u32 val);
+void vson_put_r32(vson_writer_t *w, const char *label, r32 val);
+void vson_put_r64(vson_writer_t *w, const char *label, r64 val);
+void vson_put_str(vson_writer_t *w, const char *label, const char *val);
+void vson_put_r32_array(vson_writer_t *w, const char *label, const r32 *vals,
+                        u32 n, vson_array_encoding_t enc);
+void vson_put_v2f_array(vson_writer_t *w, const char *label, const v2f *vals,
+                        u32 n, vson_array_encoding_t enc);
+void vson_put_struct(vson_writer_t *w, const void *s, const vson_field_t *fields,
+                     u32 n);
 
 #endif
 
@@ -38,184 +255,1542 @@ void vson_write_str(FILE *fp, const char *label, const char *val);
 #include <stdlib.h>
 #include <string.h>
 
-static b32 vson__read_label(FILE *fp, const char *label)
+/* 64-bit file offsets, since long is 32 bits on Windows */
+#ifdef _WIN32
+#define vson__fseek(fp, off, whence) _fseeki64(fp, off, whence)
+#define vson__ftell(fp)              _ftelli64(fp)
+#else
+#define vson__fseek(fp, off, whence) fseeko(fp, off, whence)
+#define vson__ftell(fp)              ftello(fp)
+#endif
+
+/* Reader */
+
+/* Binary records: [tag u8][label id u16][payload], where a label is defined
+ * by a [VSON__TAG_LABEL][len u8][chars] record before its first use. */
+#define VSON__BINARY_MAGIC    "VSB\1"
+#define VSON__BINARY_MAGIC_SZ 4
+#define VSON__MAX_LABELS      UINT16_MAX
+
+/* Header index trailer, after the last record:
+ *   text   - "vson_index: n" & n "label: offset" lines, then a fixed width
+ *            "vson_index_at: offset" line
+ *   binary - [n labels u32]([len u8][chars])*, [n u32]([label id u16]
+ *            [offset u64])*, then [index offset u64][VSON__INDEX_MAGIC]
+ * Offsets are from the start of the document. The binary trailer repeats
+ * every label, since a section may use ids defined before it. */
+#define VSON__INDEX_LABEL      "vson_index"
+#define VSON__INDEX_AT_LABEL   "vson_index_at"
+#define VSON__INDEX_AT_DIGITS  20
+#define VSON__TEXT_FOOTER_SZ   (sizeof(VSON__INDEX_AT_LABEL ": ") - 1 \
+                                + VSON__INDEX_AT_DIGITS + 1)
+#define VSON__INDEX_MAGIC      "VSBX"
+#define VSON__BINARY_FOOTER_SZ (8 + 4)
+
+enum
 {
-	b32 retval = false;
-	char c = 0;
-	char label_buf[VSON_LABEL_SZ], *bufp = label_buf;
-	while ((c = fgetc(fp)) != EOF && isspace((u8)c))
-		;
-	if (isspace((u8)c)) {
-		log_error("vson: failed reading label %s", label);
-		goto out;
+	VSON__TAG_LABEL = 1,
+	VSON__TAG_HEADER,
+	VSON__TAG_B32,
+	VSON__TAG_S32,
+	VSON__TAG_U32,
+	VSON__TAG_R32,
+	VSON__TAG_R64,
+	VSON__TAG_STR,       /* u32 length, then the chars */
+	VSON__TAG_R32_ARRAY, /* u32 count, then the values */
+	VSON__TAG_COUNT
+};
+
+static const u8 g_vson__payload_sz[VSON__TAG_COUNT] = {
+	[VSON__TAG_HEADER] = 0,
+	[VSON__TAG_B32]    = 1,
+	[VSON__TAG_S32]    = 4,
+	[VSON__TAG_U32]    = 4,
+	[VSON__TAG_R32]    = 4,
+	[VSON__TAG_R64]    = 8,
+	[VSON__TAG_STR]    = 4,
+	[VSON__TAG_R32_ARRAY] = 4,
+};
+
+/* finds the footer of an index trailer ending at end - returns its size &
+ * the offset of the index, or 0 if there is none */
+static u32 vson__footer(const char *end, size_t sz, vson_format_t format,
+                        u64 *index_off)
+{
+	if (format == VSON_BINARY) {
+		if (   sz < VSON__BINARY_FOOTER_SZ
+		    || memcmp(end - 4, VSON__INDEX_MAGIC, 4) != 0)
+			return 0;
+		memcpy(index_off, end - VSON__BINARY_FOOTER_SZ, sizeof(*index_off));
+		return VSON__BINARY_FOOTER_SZ;
+	} else {
+		const char *p;
+		u64 off = 0;
+		if (sz < VSON__TEXT_FOOTER_SZ || end[-1] != '\n')
+			return 0;
+		p = end - VSON__TEXT_FOOTER_SZ;
+		if (memcmp(p, VSON__INDEX_AT_LABEL ": ", sizeof(VSON__INDEX_AT_LABEL ": ") - 1) != 0)
+			return 0;
+		p += sizeof(VSON__INDEX_AT_LABEL ": ") - 1;
+		for (u32 i = 0; i < VSON__INDEX_AT_DIGITS; ++i, ++p) {
+			if ((u8)(*p - '0') > 9)
+				return 0;
+			off = off * 10 + (u8)(*p - '0');
+		}
+		*index_off = off;
+		return VSON__TEXT_FOOTER_SZ;
 	}
+}
 
-	*(bufp++) = c;
+void vson_reader_init(vson_reader_t *r, const void *buf, size_t sz)
+{
+	u64 index_off;
+	u32 footer_sz;
+	r->p              = buf;
+	r->end            = r->p + sz;
+	r->begin          = buf;
+	r->base           = 0;
+	r->index          = NULL;
+	r->index_end      = NULL;
+	r->owned          = NULL;
+	r->allocator      = NULL;
+	r->format         = VSON_TEXT;
+	r->labels_indexed = false;
+	r->labels         = NULL;
+	r->sections       = NULL;
+	if (   sz >= VSON__BINARY_MAGIC_SZ
+	    && memcmp(buf, VSON__BINARY_MAGIC, VSON__BINARY_MAGIC_SZ) == 0) {
+		r->format = VSON_BINARY;
+		r->p += VSON__BINARY_MAGIC_SZ;
+	}
+	/* the trailer isn't part of the records */
+	footer_sz = vson__footer(r->end, sz, r->format, &index_off);
+	if (   footer_sz
+	    && index_off >= (u64)(r->p - r->begin)
+	    && index_off <= sz - footer_sz) {
+		r->index     = r->begin + index_off;
+		r->index_end = r->end - footer_sz;
+		r->end       = r->index;
+	}
+}
 
-	while (bufp - label_buf < VSON_LABEL_SZ && (c = fgetc(fp)) != EOF && c != ':')
-		*(bufp++) = c;
-	if (c != ':') {
-		log_error("vson: missing colon after label %s", label);
-		goto out;
+b32 vson_reader_load(vson_reader_t *r, const char *fname, allocator_t *a)
+{
+	FILE *fp = fopen(fname, "rb");
+	b32 ret;
+	if (!fp) {
+		log_error("vson: failed to open %s", fname);
+		vson_reader_init(r, NULL, 0);
+		return false;
 	}
+	ret = vson_reader_load_fp(r, fp, a);
+	fclose(fp);
+	return ret;
+}
 
-	*bufp = '\0';
-	if (strcmp(label_buf, label) != 0) {
-		log_error("vson: expected %s, got %s", label, label_buf);
-		goto out;
+b32 vson_reader_load_fp(vson_reader_t *r, FILE *fp, allocator_t *a)
+{
+	size_t cap = 1 << 16, sz = 0, n;
+	char *buf = amalloc(cap, a);
+	error_if(!buf, "vson: oom");
+	/* read in chunks, since the stream needn't be seekable */
+	while ((n = fread(buf + sz, 1, cap - sz, fp)) > 0) {
+		sz += n;
+		if (sz == cap) {
+			cap *= 2;
+			buf = arealloc(buf, cap, a);
+			error_if(!buf, "vson: oom");
+		}
 	}
+	vson_reader_init(r, buf, sz);
+	r->owned     = buf;
+	r->allocator = a;
+	return !ferror(fp);
+}
 
-	retval = fgetc(fp) == ' ';
-out:
-	return retval;
+void vson_reader_destroy(vson_reader_t *r)
+{
+	if (r->labels)
+		array_destroy(r->labels);
+	if (r->sections)
+		array_destroy(r->sections);
+	if (r->owned)
+		afree(r->owned, r->allocator);
+	vson_reader_init(r, NULL, 0);
 }
 
-static b32 vson__skip_rest_of_line(FILE *fp)
+static b32 vson__label_eq(const vson__label_t *l, const char *str)
 {
-	char c;
-	while ((c = fgetc(fp)) != EOF && c != '\n')
-		;
-	return c == '\n';
+	return strncmp(l->str, str, l->len) == 0 && str[l->len] == '\0';
 }
 
-static b32 vson__read_rest_of_line(FILE *fp, char *str, u32 n)
+/* the payload size of the record at p, with a valid tag - false if the
+ * record runs past end */
+static b32 vson__bin_payload_sz(const char *p, const char *end, u8 tag, u64 *sz)
 {
-	char c, *p = str;
-	while ((u32)(p - str) < n && (c = fgetc(fp)) != EOF && c != '\n')
-		*(p++) = c;
-	if (c != '\n') {
-		vson__skip_rest_of_line(fp);
+	u32 n;
+	*sz = g_vson__payload_sz[tag];
+	if ((u64)(end - p - 3) < *sz)
 		return false;
+	if (tag == VSON__TAG_STR || tag == VSON__TAG_R32_ARRAY) {
+		memcpy(&n, p + 3, sizeof(n));
+		*sz += tag == VSON__TAG_STR ? (u64)n : (u64)n * sizeof(r32);
 	}
-	if (p > str && p[-1] == '\r')
-		p[-1] = '\0';
+	return (u64)(end - p - 3) >= *sz;
+}
+
+/* consumes the next record - returns its tag, label & payload, or 0 on
+ * failure (label is only for error messages) */
+static u8 vson__bin_next(vson_reader_t *r, const char *label,
+                         const vson__label_t **rec_label, const char **payload)
+{
+	const char *p = r->p, *end = r->end;
+	u16 id;
+	u8 tag;
+	u64 sz;
+
+	while (p != end && (u8)*p == VSON__TAG_LABEL) {
+		if (end - p < 2 || end - p < 2 + (u8)p[1])
+			goto truncated;
+		/* the index already defined every label */
+		if (!r->labels_indexed) {
+			vson__label_t *def;
+			if (!r->labels)
+				r->labels = array_create_ex(r->allocator ? r->allocator : g_allocator);
+			def = array_append_null(r->labels);
+			def->str = p + 2;
+			def->len = (u8)p[1];
+			def->hash = hashn(def->str, def->len);
+		}
+		p += 2 + (u8)p[1];
+	}
+	r->p = p;
+
+	if (end - p < 3)
+		goto truncated;
+	tag = (u8)p[0];
+	memcpy(&id, p + 1, sizeof(id));
+	/* labels is still NULL if no label was defined before the record */
+	if (   tag <= VSON__TAG_LABEL || tag >= VSON__TAG_COUNT
+	    || !r->labels || id >= array_sz(r->labels)) {
+		log_error("vson: corrupt record before label %s", label);
+		r->p = end;
+		return 0;
+	}
+	if (!vson__bin_payload_sz(p, end, tag, &sz))
+		goto truncated;
+	r->p = p + 3 + sz;
+	*rec_label = &r->labels[id];
+	*payload = p + 3;
+	return tag;
+
+truncated:
+	log_error("vson: failed reading label %s", label);
+	r->p = end;
+	return 0;
+}
+
+/* consumes the next record, which has to be labelled label - returns its tag
+ * & payload, or 0 on failure */
+static u8 vson__bin_record(vson_reader_t *r, const char *label, const char **payload)
+{
+	const vson__label_t *rec_label;
+	const u8 tag = vson__bin_next(r, label, &rec_label, payload);
+	if (tag && !vson__label_eq(rec_label, label)) {
+		log_error("vson: expected %s, got %.*s", label, (int)rec_label->len,
+		          rec_label->str);
+		return 0;
+	}
+	return tag;
+}
+
+static const char *vson__line_end(const vson_reader_t *r)
+{
+	const char *eol = memchr(r->p, '\n', r->end - r->p);
+	return eol ? eol : r->end;
+}
+
+static void vson__skip_rest_of_line(vson_reader_t *r)
+{
+	const char *eol = vson__line_end(r);
+	r->p = eol < r->end ? eol + 1 : eol;
+}
+
+/* consumes the label if it's next, otherwise stops at the start of the line */
+static b32 vson__label_at(vson_reader_t *r, const char *label)
+{
+	const char *p = r->p, *end = r->end, *l = label;
+
+	while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+		++p;
+	r->p = p;
+
+	while (p != end && *l != '\0' && *p == *l)
+		++p, ++l;
+	if (*l == '\0' && end - p >= 2 && p[0] == ':' && p[1] == ' ') {
+		r->p = p + 2;
+		return true;
+	}
+	return false;
+}
+
+static b32 vson__label(vson_reader_t *r, const char *label)
+{
+	const char *p, *end = r->end, *l = label;
+
+	if (vson__label_at(r, label))
+		return true;
+	p = r->p;
+	if (p == end) {
+		log_error("vson: failed reading label %s", label);
+		return false;
+	}
+
+	while (p != end && *l != '\0' && *p == *l)
+		++p, ++l;
+
+	while (p != end && *p != ':' && *p != '\n' && p - r->p <= VSON_LABEL_SZ)
+		++p;
+	if (p == end || *p != ':')
+		log_error("vson: missing colon after label %s", label);
+	else if (*l == '\0' && p == r->p + (l - label))
+		log_error("vson: missing space after label %s", label);
 	else
-		*p = '\0';
+		log_error("vson: expected %s, got %.*s", label, (int)(p - r->p), r->p);
+	return false;
+}
+
+/* parses the value in place when it's followed by a newline, which stops
+ * strtod before the end of the span - otherwise from a copy. strtod would
+ * skip a newline as leading whitespace, so the value must start with a
+ * printable char on this line. */
+#define VSON__PARSE_REAL(r, val, strto) \
+	do { \
+		const char *eol = vson__line_end(r), *num = (r)->p; \
+		char *num_end; \
+		while (num != eol && *num == ' ') \
+			++num; \
+		if (num == eol || (u8)*num <= ' ') \
+			goto fail; \
+		if (eol != (r)->end) { \
+			*(val) = strto(num, &num_end); \
+			if (num_end == num || num_end > eol) \
+				goto fail; \
+		} else { \
+			char buf[VSON_VALUE_SZ]; \
+			if (eol - num >= VSON_VALUE_SZ) \
+				goto fail; \
+			memcpy(buf, num, eol - num); \
+			buf[eol - num] = '\0'; \
+			*(val) = strto(buf, &num_end); \
+			if (num_end == buf) \
+				goto fail; \
+		} \
+	} while (0)
+
+static b32 vson__parse_int(vson_reader_t *r, s64 *val)
+{
+	const char *p = r->p, *end = vson__line_end(r);
+	b32 neg = false;
+	u64 x = 0;
+	while (p != end && *p == ' ')
+		++p;
+	if (p != end && (*p == '-' || *p == '+'))
+		neg = *p++ == '-';
+	if (p == end || (u8)(*p - '0') > 9)
+		return false;
+	for (; p != end && (u8)(*p - '0') <= 9; ++p)
+		x = x * 10 + (u8)(*p - '0');
+	*val = neg ? -(s64)x : (s64)x;
 	return true;
 }
 
-b32 vson_read_header(FILE *fp, const char *label)
+b32 vson_get_header(vson_reader_t *r, const char *label)
 {
-	const b32 ret = vson__read_label(fp, label);
-	vson__skip_rest_of_line(fp);
+	b32 ret;
+	if (r->format == VSON_BINARY) {
+		const char *payload;
+		return vson__bin_record(r, label, &payload) == VSON__TAG_HEADER;
+	}
+	ret = vson__label(r, label);
+	vson__skip_rest_of_line(r);
 	return ret;
 }
 
-b32 vson_read_b8(FILE *fp, const char *label, b8 *val)
+b32 vson_get_b32(vson_reader_t *r, const char *label, b32 *val)
 {
-	b32 val_;
-	if (vson_read_b32(fp, label, &val_)) {
-		*val = val_;
+	if (r->format == VSON_BINARY) {
+		const char *payload;
+		if (vson__bin_record(r, label, &payload) != VSON__TAG_B32)
+			return false;
+		*val = *payload != 0;
 		return true;
 	}
+	if (vson__label(r, label) && r->p != r->end) {
+		*val = *r->p != '0' && *r->p != 'f';
+		vson__skip_rest_of_line(r);
+		return true;
+	}
+	vson__skip_rest_of_line(r);
 	return false;
 }
 
-b32 vson_read_u8(FILE *fp, const char *label, u8 *val)
+b32 vson_get_b8(vson_reader_t *r, const char *label, b8 *val)
 {
-	u32 val_;
-	if (vson_read_u32(fp, label, &val_) && val_ <= UINT8_MAX) {
+	b32 val_;
+	if (vson_get_b32(r, label, &val_)) {
 		*val = val_;
 		return true;
 	}
 	return false;
 }
 
-b32 vson_read_s8(FILE *fp, const char *label, s8 *val)
+static b32 vson__get_int(vson_reader_t *r, const char *label, s64 *val)
 {
-	s32 val_;
-	if (   vson_read_s32(fp, label, &val_)
-	    && val_ >= INT8_MIN
-	    && val_ <= INT8_MAX) {
-		*val = val_;
+	b32 ret;
+	if (r->format == VSON_BINARY) {
+		const char *payload;
+		s32 s;
+		u32 u;
+		switch (vson__bin_record(r, label, &payload)) {
+		case VSON__TAG_S32:
+			memcpy(&s, payload, sizeof(s));
+			*val = s;
+			return true;
+		case VSON__TAG_U32:
+			memcpy(&u, payload, sizeof(u));
+			*val = u;
+			return true;
+		default:
+			return false;
+		}
+	}
+	ret = vson__label(r, label) && vson__parse_int(r, val);
+	vson__skip_rest_of_line(r);
+	return ret;
+}
+
+#define VSON__GET_INT(type, min, max) \
+	s64 val_; \
+	const b32 ret =    vson__get_int(r, label, &val_) \
+	                && val_ >= (min) \
+	                && val_ <= (max); \
+	if (ret) \
+		*val = (type)val_; \
+	return ret;
+
+b32 vson_get_u8(vson_reader_t *r, const char *label, u8 *val)
+{
+	VSON__GET_INT(u8, 0, UINT8_MAX)
+}
+
+b32 vson_get_s8(vson_reader_t *r, const char *label, s8 *val)
+{
+	VSON__GET_INT(s8, INT8_MIN, INT8_MAX)
+}
+
+b32 vson_get_u16(vson_reader_t *r, const char *label, u16 *val)
+{
+	VSON__GET_INT(u16, 0, UINT16_MAX)
+}
+
+b32 vson_get_s16(vson_reader_t *r, const char *label, s16 *val)
+{
+	VSON__GET_INT(s16, INT16_MIN, INT16_MAX)
+}
+
+/* 32-bit values wrap like strtol/strtoul used to */
+b32 vson_get_s32(vson_reader_t *r, const char *label, s32 *val)
+{
+	VSON__GET_INT(s32, INT64_MIN, INT64_MAX)
+}
+
+b32 vson_get_u32(vson_reader_t *r, const char *label, u32 *val)
+{
+	VSON__GET_INT(u32, INT64_MIN, INT64_MAX)
+}
+
+/* reals are read from either width */
+static b32 vson__bin_real(vson_reader_t *r, const char *label, r64 *val)
+{
+	const char *payload;
+	r32 f;
+	switch (vson__bin_record(r, label, &payload)) {
+	case VSON__TAG_R32:
+		memcpy(&f, payload, sizeof(f));
+		*val = f;
 		return true;
+	case VSON__TAG_R64:
+		memcpy(val, payload, sizeof(*val));
+		return true;
+	default:
+		return false;
 	}
+}
+
+b32 vson_get_r32(vson_reader_t *r, const char *label, r32 *val)
+{
+	if (r->format == VSON_BINARY) {
+		r64 val_;
+		if (!vson__bin_real(r, label, &val_))
+			return false;
+		*val = (r32)val_;
+		return true;
+	}
+	if (!vson__label(r, label))
+		goto fail;
+	VSON__PARSE_REAL(r, val, strtof);
+	vson__skip_rest_of_line(r);
+	return true;
+fail:
+	vson__skip_rest_of_line(r);
 	return false;
 }
 
-b32 vson_read_u16(FILE *fp, const char *label, u16 *val)
+b32 vson_get_r64(vson_reader_t *r, const char *label, r64 *val)
 {
-	u32 val_;
-	if (vson_read_u32(fp, label, &val_) && val_ <= UINT16_MAX) {
-		*val = val_;
+	if (r->format == VSON_BINARY)
+		return vson__bin_real(r, label, val);
+	if (!vson__label(r, label))
+		goto fail;
+	VSON__PARSE_REAL(r, val, strtod);
+	vson__skip_rest_of_line(r);
+	return true;
+fail:
+	vson__skip_rest_of_line(r);
+	return false;
+}
+
+b32 vson_get_str_view(vson_reader_t *r, const char *label, const char **val,
+                      u32 *len)
+{
+	const char *eol;
+	if (r->format == VSON_BINARY) {
+		const char *payload;
+		if (vson__bin_record(r, label, &payload) != VSON__TAG_STR)
+			return false;
+		memcpy(len, payload, sizeof(*len));
+		*val = payload + sizeof(*len);
+		return true;
+	}
+	if (!vson__label(r, label)) {
+		vson__skip_rest_of_line(r);
+		return false;
+	}
+	eol = vson__line_end(r);
+	*val = r->p;
+	*len = (u32)(eol - r->p);
+	if (*len > 0 && eol[-1] == '\r')
+		--*len;
+	r->p = eol < r->end ? eol + 1 : eol;
+	return true;
+}
+
+b32 vson_get_str(vson_reader_t *r, const char *label, char *val, u32 sz)
+{
+	const char *str;
+	u32 len;
+	if (!vson_get_str_view(r, label, &str, &len))
+		return false;
+	if (len >= sz) {
+		memcpy(val, str, sz - 1);
+		val[sz-1] = '\0';
+		return false;
+	}
+	memcpy(val, str, len);
+	val[len] = '\0';
+	return true;
+}
+
+/* Real arrays - "label: n v0 v1 ..." or "label: n b64:<base64>" */
+
+#define VSON__B64_PREFIX "b64:"
+
+static const char g_vson__b64[64] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int vson__b64_val(u8 c)
+{
+	if ((u8)(c - 'A') < 26)
+		return c - 'A';
+	if ((u8)(c - 'a') < 26)
+		return c - 'a' + 26;
+	if ((u8)(c - '0') < 10)
+		return c - '0' + 52;
+	return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+static size_t vson__b64_encode(char *dst, const void *src, size_t sz)
+{
+	const u8 *s = src;
+	char *d = dst;
+	size_t i;
+	for (i = 0; i + 3 <= sz; i += 3, d += 4) {
+		const u32 v = (u32)s[i] << 16 | (u32)s[i+1] << 8 | s[i+2];
+		d[0] = g_vson__b64[v >> 18];
+		d[1] = g_vson__b64[v >> 12 & 63];
+		d[2] = g_vson__b64[v >> 6 & 63];
+		d[3] = g_vson__b64[v & 63];
+	}
+	if (i < sz) {
+		const u32 v = (u32)s[i] << 16 | (i + 1 < sz ? (u32)s[i+1] << 8 : 0);
+		d[0] = g_vson__b64[v >> 18];
+		d[1] = g_vson__b64[v >> 12 & 63];
+		d[2] = i + 1 < sz ? g_vson__b64[v >> 6 & 63] : '=';
+		d[3] = '=';
+		d += 4;
+	}
+	return d - dst;
+}
+
+/* decodes exactly sz bytes */
+static b32 vson__b64_decode(void *dst, size_t sz, const char *src, const char *end)
+{
+	u8 *d = dst;
+	if ((size_t)(end - src) < (sz + 2) / 3 * 4)
+		return false;
+	for (size_t i = 0; i < sz; i += 3, src += 4) {
+		const int a = vson__b64_val(src[0]), b = vson__b64_val(src[1]);
+		const int c = vson__b64_val(src[2]), e = vson__b64_val(src[3]);
+		u32 v;
+		if ((a | b) < 0 || (i + 1 < sz && c < 0) || (i + 2 < sz && e < 0))
+			return false;
+		v = (u32)a << 18 | (u32)b << 12 | (u32)(c & 63) << 6 | (u32)(e & 63);
+		d[i] = (u8)(v >> 16);
+		if (i + 1 < sz)
+			d[i+1] = (u8)(v >> 8);
+		if (i + 2 < sz)
+			d[i+2] = (u8)v;
+	}
+	return true;
+}
+
+/* parses the next real in [*p, eol) - in place, unless it could run into
+ * the end of the span. Like VSON__PARSE_REAL, strtof mustn't see leading
+ * whitespace, as it would skip the newline. */
+static b32 vson__parse_r32(const vson_reader_t *r, const char **p, const char *eol,
+                           r32 *val)
+{
+	const char *s = *p;
+	char *num_end;
+	while (s != eol && *s == ' ')
+		++s;
+	if (s == eol || (u8)*s <= ' ')
+		return false;
+	if (eol != r->end) {
+		*val = strtof(s, &num_end);
+		if (num_end == s || num_end > eol)
+			return false;
+		*p = num_end;
+	} else {
+		char buf[VSON_VALUE_SZ];
+		const char *e = s;
+		while (e != eol && *e != ' ' && e - s < VSON_VALUE_SZ - 1)
+			++e;
+		memcpy(buf, s, e - s);
+		buf[e - s] = '\0';
+		*val = strtof(buf, &num_end);
+		if (num_end == buf)
+			return false;
+		*p = s + (num_end - buf);
+	}
+	return true;
+}
+
+b32 vson_get_r32_array(vson_reader_t *r, const char *label, r32 *vals, u32 cap,
+                       u32 *n)
+{
+	const char *p, *eol;
+	u64 count = 0;
+	if (r->format == VSON_BINARY) {
+		const char *payload;
+		if (vson__bin_record(r, label, &payload) != VSON__TAG_R32_ARRAY)
+			return false;
+		memcpy(n, payload, sizeof(*n));
+		if (*n > cap) {
+			log_error("vson: %s has %u values, more than %u", label, *n, cap);
+			return false;
+		}
+		if (*n)
+			memcpy(vals, payload + sizeof(*n), *n * sizeof(r32));
 		return true;
 	}
+
+	if (!vson__label(r, label))
+		goto fail;
+	eol = vson__line_end(r);
+	p = r->p;
+	while (p != eol && *p == ' ')
+		++p;
+	if (p == eol || (u8)(*p - '0') > 9)
+		goto fail;
+	for (; p != eol && (u8)(*p - '0') <= 9 && count <= UINT32_MAX; ++p)
+		count = count * 10 + (u8)(*p - '0');
+	if (count > cap) {
+		log_error("vson: %s has %" PRIu64 " values, more than %u", label, count, cap);
+		goto fail;
+	}
+	*n = (u32)count;
+	while (p != eol && *p == ' ')
+		++p;
+	if (   (size_t)(eol - p) >= sizeof(VSON__B64_PREFIX) - 1
+	    && memcmp(p, VSON__B64_PREFIX, sizeof(VSON__B64_PREFIX) - 1) == 0) {
+		p += sizeof(VSON__B64_PREFIX) - 1;
+		if (!vson__b64_decode(vals, *n * sizeof(r32), p, eol))
+			goto fail;
+	} else {
+		for (u32 i = 0; i < *n; ++i)
+			if (!vson__parse_r32(r, &p, eol, &vals[i]))
+				goto fail;
+	}
+	vson__skip_rest_of_line(r);
+	return true;
+
+fail:
+	vson__skip_rest_of_line(r);
+	return false;
+}
+
+b32 vson_get_v2f_array(vson_reader_t *r, const char *label, v2f *vals, u32 cap,
+                       u32 *n)
+{
+	const u32 cap_reals = cap < VSON_ARRAY_MAX_N / 2 ? cap * 2 : VSON_ARRAY_MAX_N;
+	u32 n_reals;
+	if (!vson_get_r32_array(r, label, (r32*)vals, cap_reals, &n_reals))
+		return false;
+	if (n_reals % 2 != 0) {
+		log_error("vson: %s has an odd number of values", label);
+		return false;
+	}
+	*n = n_reals / 2;
+	return true;
+}
+
+static b32 vson__array_fits(const char *label, u64 n)
+{
+	if (n <= VSON_ARRAY_MAX_N)
+		return true;
+	log_error("vson: %s has %" PRIu64 " values, more than %u", label, n,
+	          VSON_ARRAY_MAX_N);
 	return false;
 }
 
-b32 vson_read_s16(FILE *fp, const char *label, s16 *val)
+/* chars needed to format n values */
+static size_t vson__r32_array_max_sz(u32 n, vson_array_encoding_t enc)
 {
-	s32 val_;
-	if (   vson_read_s32(fp, label, &val_)
-	    && val_ >= INT16_MIN
-	    && val_ <= INT16_MAX) {
-		*val = val_;
+	return FMT_INT_SZ + 1 + (enc == VSON_ARRAY_BASE64
+	                         ? sizeof(VSON__B64_PREFIX) - 1 + ((size_t)n * 4 + 2) / 3 * 4
+	                         : (size_t)n * (FMT_REAL_SZ + 1));
+}
+
+static u32 vson__fmt_r32_array(char *dst, const r32 *vals, u32 n,
+                               vson_array_encoding_t enc)
+{
+	char *p = dst + fmt_u64(dst, n, 0);
+	if (n == 0)
+		return (u32)(p - dst);
+	*p++ = ' ';
+	if (enc == VSON_ARRAY_BASE64) {
+		memcpy(p, VSON__B64_PREFIX, sizeof(VSON__B64_PREFIX) - 1);
+		p += sizeof(VSON__B64_PREFIX) - 1;
+		p += vson__b64_encode(p, vals, (size_t)n * sizeof(r32));
+	} else {
+		for (u32 i = 0; i < n; ++i) {
+			if (i)
+				*p++ = ' ';
+			p += fmt_r32(p, vals[i]);
+		}
+	}
+	return (u32)(p - dst);
+}
+
+/* Structs */
+
+/* the label of the next text record, without consuming it */
+static b32 vson__peek_label(vson_reader_t *r, vson__label_t *label)
+{
+	const char *p = r->p, *end = r->end, *colon;
+	while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+		++p;
+	r->p = p;
+	for (colon = p; colon != end && *colon != ':' && *colon != '\n'; ++colon)
+		;
+	if (end - colon < 2 || colon[0] != ':' || colon[1] != ' ')
+		return false;
+	label->str = p;
+	label->len = (u32)(colon - p);
+	return true;
+}
+
+/* 32-bit values wrap, like vson_get_s32/u32 */
+static b32 vson__set_int(const vson_field_t *f, void *dst, s64 val)
+{
+	switch (f->type) {
+	case VSON_FIELD_U8:
+		if (val < 0 || val > UINT8_MAX)
+			return false;
+		*(u8*)dst = (u8)val;
+		return true;
+	case VSON_FIELD_S8:
+		if (val < INT8_MIN || val > INT8_MAX)
+			return false;
+		*(s8*)dst = (s8)val;
+		return true;
+	case VSON_FIELD_U16:
+		if (val < 0 || val > UINT16_MAX)
+			return false;
+		*(u16*)dst = (u16)val;
+		return true;
+	case VSON_FIELD_S16:
+		if (val < INT16_MIN || val > INT16_MAX)
+			return false;
+		*(s16*)dst = (s16)val;
+		return true;
+	case VSON_FIELD_U32:
+		*(u32*)dst = (u32)val;
+		return true;
+	case VSON_FIELD_S32:
+		*(s32*)dst = (s32)val;
+		return true;
+	default:
+		assert(false);
+		return false;
+	}
+}
+
+static b32 vson__set_str(const vson_field_t *f, void *dst, const char *str, u32 len)
+{
+	const b32 fits = len < f->sz;
+	if (!fits)
+		len = f->sz - 1;
+	memcpy(dst, str, len);
+	((char*)dst)[len] = '\0';
+	return fits;
+}
+
+static b32 vson__bin_field(const vson_field_t *f, void *dst, u8 tag,
+                           const char *payload)
+{
+	s32 s;
+	u32 u;
+	r32 f32;
+	r64 f64;
+	switch (f->type) {
+	case VSON_FIELD_B8:
+	case VSON_FIELD_B32:
+		if (tag != VSON__TAG_B32)
+			return false;
+		if (f->type == VSON_FIELD_B8)
+			*(b8*)dst = *payload != 0;
+		else
+			*(b32*)dst = *payload != 0;
+		return true;
+	case VSON_FIELD_R32:
+	case VSON_FIELD_R64:
+		if (tag == VSON__TAG_R32) {
+			memcpy(&f32, payload, sizeof(f32));
+			f64 = f32;
+		} else if (tag == VSON__TAG_R64) {
+			memcpy(&f64, payload, sizeof(f64));
+		} else {
+			return false;
+		}
+		if (f->type == VSON_FIELD_R32)
+			*(r32*)dst = (r32)f64;
+		else
+			*(r64*)dst = f64;
 		return true;
+	case VSON_FIELD_STR:
+		if (tag != VSON__TAG_STR)
+			return false;
+		memcpy(&u, payload, sizeof(u));
+		return vson__set_str(f, dst, payload + sizeof(u), u);
+	default:
+		if (tag == VSON__TAG_S32) {
+			memcpy(&s, payload, sizeof(s));
+			return vson__set_int(f, dst, s);
+		} else if (tag == VSON__TAG_U32) {
+			memcpy(&u, payload, sizeof(u));
+			return vson__set_int(f, dst, u);
+		}
+		return false;
+	}
+}
+
+/* r is past the label */
+static b32 vson__text_field(vson_reader_t *r, const vson_field_t *f, void *dst)
+{
+	const char *eol;
+	s64 val;
+	switch (f->type) {
+	case VSON_FIELD_B8:
+	case VSON_FIELD_B32:
+		if (r->p == r->end)
+			goto fail;
+		if (f->type == VSON_FIELD_B8)
+			*(b8*)dst = *r->p != '0' && *r->p != 'f';
+		else
+			*(b32*)dst = *r->p != '0' && *r->p != 'f';
+		break;
+	case VSON_FIELD_R32:
+		VSON__PARSE_REAL(r, (r32*)dst, strtof);
+		break;
+	case VSON_FIELD_R64:
+		VSON__PARSE_REAL(r, (r64*)dst, strtod);
+		break;
+	case VSON_FIELD_STR:
+		eol = vson__line_end(r);
+		if (eol != r->p && eol[-1] == '\r')
+			--eol;
+		if (!vson__set_str(f, dst, r->p, (u32)(eol - r->p)))
+			goto fail;
+		break;
+	default:
+		if (!vson__parse_int(r, &val) || !vson__set_int(f, dst, val))
+			goto fail;
 	}
+	vson__skip_rest_of_line(r);
+	return true;
+fail:
+	vson__skip_rest_of_line(r);
 	return false;
 }
 
-b32 vson_read_b32(FILE *fp, const char *label, b32 *val)
+static u32 vson__find_field(const vson_field_t *fields, u32 first, u32 last,
+                            const vson__label_t *label, u32 hash)
+{
+	u32 i;
+	for (i = first; i < last; ++i)
+		if (   fields[i].hash == hash && fields[i].len == label->len
+		    && memcmp(fields[i].label, label->str, label->len) == 0)
+			break;
+	return i;
+}
+
+/* reads the next record into the first of fields[*i, n) it's labelled as.
+ * Sets *end instead if the record isn't one of those (or there is none) -
+ * it follows the struct, so it's left unread. */
+static b32 vson__get_struct_record(vson_reader_t *r, void *s,
+                                   const vson_field_t *fields, u32 n, u32 *i,
+                                   b32 *end)
+{
+	const vson__label_t *label;
+	vson__label_t text_label;
+	const char *payload = NULL;
+	u8 tag = 0;
+	u32 h, j = *i;
+	b32 ret;
+
+	/* binary labels were hashed when defined - text labels are matched in
+	 * place & only hashed to skip fields */
+	if (r->format == VSON_BINARY) {
+		if (r->p == r->end)
+			goto end;
+		tag = vson__bin_next(r, fields[j].label, &label, &payload);
+		if (!tag)
+			return false;
+		/* a header starts the next section, even if labelled like a member */
+		if (tag == VSON__TAG_HEADER) {
+			r->p = payload - 3;
+			goto end;
+		}
+		h = label->hash;
+	} else if (vson__label_at(r, fields[j].label)) {
+		goto matched;
+	} else if (r->p == r->end) {
+		goto end;
+	} else if (vson__peek_label(r, &text_label)) {
+		label = &text_label;
+		h = hashn(label->str, label->len);
+	} else {
+		log_error("vson: failed reading label %s", fields[j].label);
+		vson__skip_rest_of_line(r);
+		return false;
+	}
+
+	j = vson__find_field(fields, j, n, label, h);
+	if (j == n) {
+		if (r->format == VSON_BINARY)
+			r->p = payload - 3;
+		if (vson__find_field(fields, 0, *i, label, h) != *i) {
+			log_error("vson: %.*s out of order", (int)label->len, label->str);
+			return false;
+		}
+		goto end;
+	}
+	if (r->format == VSON_TEXT)
+		r->p = label->str + label->len + 2;
+
+matched:
+	*i = j + 1;
+	if (r->format == VSON_BINARY)
+		ret = vson__bin_field(&fields[j], (u8*)s + fields[j].offset, tag, payload);
+	else
+		ret = vson__text_field(r, &fields[j], (u8*)s + fields[j].offset);
+	if (!ret)
+		log_error("vson: failed reading %s", fields[j].label);
+	return ret;
+
+end:
+	*end = true;
+	return true;
+}
+
+b32 vson_get_struct(vson_reader_t *r, void *s, const vson_field_t *fields, u32 n)
+{
+	b32 end = false;
+	for (u32 i = 0; i < n && !end; )
+		if (!vson__get_struct_record(r, s, fields, n, &i, &end))
+			return false;
+	return true;
+}
+
+/* put is vson_put_* or vson_write_* */
+#define VSON__PUT_STRUCT(put, dst, s, fields, n) \
+	for (const vson_field_t *f = fields; f != (fields) + (n); ++f) { \
+		const void *src = (const u8*)(s) + f->offset; \
+		switch (f->type) { \
+		case VSON_FIELD_B8:  put##_b32(dst, f->label, *(const b8*)src);  break; \
+		case VSON_FIELD_B32: put##_b32(dst, f->label, *(const b32*)src); break; \
+		case VSON_FIELD_U8:  put##_u32(dst, f->label, *(const u8*)src);  break; \
+		case VSON_FIELD_S8:  put##_s32(dst, f->label, *(const s8*)src);  break; \
+		case VSON_FIELD_U16: put##_u32(dst, f->label, *(const u16*)src); break; \
+		case VSON_FIELD_S16: put##_s32(dst, f->label, *(const s16*)src); break; \
+		case VSON_FIELD_U32: put##_u32(dst, f->label, *(const u32*)src); break; \
+		case VSON_FIELD_S32: put##_s32(dst, f->label, *(const s32*)src); break; \
+		case VSON_FIELD_R32: put##_r32(dst, f->label, *(const r32*)src); break; \
+		case VSON_FIELD_R64: put##_r64(dst, f->label, *(const r64*)src); break; \
+		case VSON_FIELD_STR: put##_str(dst, f->label, (const char*)src);  break; \
+		} \
+	}
+
+static b32 vson__parse_index(vson_reader_t *r)
+{
+	allocator_t *a = r->allocator ? r->allocator : g_allocator;
+	const char *p = r->index, *end = r->index_end;
+	u32 n;
+
+	if (!r->sections)
+		r->sections = array_create_ex(a);
+	array_clear(r->sections);
+
+	if (r->format == VSON_BINARY) {
+		u32 n_labels;
+		if (end - p < 4)
+			goto corrupt;
+		memcpy(&n_labels, p, sizeof(n_labels));
+		p += 4;
+		if (!r->labels)
+			r->labels = array_create_ex(a);
+		array_clear(r->labels);
+		for (u32 i = 0; i < n_labels; ++i) {
+			vson__label_t *label;
+			if (end - p < 1 || end - p < 1 + (u8)p[0])
+				goto corrupt;
+			label = array_append_null(r->labels);
+			label->str = p + 1;
+			label->len = (u8)p[0];
+			label->hash = hashn(label->str, label->len);
+			p += 1 + label->len;
+		}
+		r->labels_indexed = true;
+
+		if (end - p < 4)
+			goto corrupt;
+		memcpy(&n, p, sizeof(n));
+		p += 4;
+		if ((size_t)(end - p) / 10 < n)
+			goto corrupt;
+		for (u32 i = 0; i < n; ++i, p += 10) {
+			vson__section_t *section = array_append_null(r->sections);
+			u16 id;
+			memcpy(&id, p, sizeof(id));
+			memcpy(&section->offset, p + 2, sizeof(section->offset));
+			if (id >= n_labels)
+				goto corrupt;
+			section->label = r->labels[id];
+		}
+	} else {
+		vson_reader_t idx;
+		s64 val;
+		vson_reader_init(&idx, p, end - p);
+		if (!vson__get_int(&idx, VSON__INDEX_LABEL, &val) || val < 0)
+			goto corrupt;
+		n = (u32)val;
+		for (u32 i = 0; i < n; ++i) {
+			vson__section_t *section = array_append_null(r->sections);
+			const char *eol = vson__line_end(&idx);
+			const char *colon = memchr(idx.p, ':', eol - idx.p);
+			if (!colon)
+				goto corrupt;
+			section->label.str = idx.p;
+			section->label.len = (u32)(colon - idx.p);
+			idx.p = colon + 1;
+			if (!vson__parse_int(&idx, &val) || val < 0)
+				goto corrupt;
+			section->offset = (u64)val;
+			vson__skip_rest_of_line(&idx);
+		}
+	}
+	return true;
+
+corrupt:
+	log_error("vson: corrupt header index");
+	array_clear(r->sections);
+	return false;
+}
+
+static const vson__section_t *vson__find_section(const vson_reader_t *r,
+                                                 const char *label)
+{
+	array_foreach(r->sections, const vson__section_t, section)
+		if (vson__label_eq(&section->label, label))
+			return section;
+	log_error("vson: no section %s in the index", label);
+	return NULL;
+}
+
+b32 vson_seek_header(vson_reader_t *r, const char *label)
+{
+	const vson__section_t *section;
+	if (!r->index) {
+		log_error("vson: no index to find %s", label);
+		return false;
+	}
+	if (!r->sections && !vson__parse_index(r))
+		return false;
+	section = vson__find_section(r, label);
+	if (!section)
+		return false;
+	if (   section->offset < r->base
+	    || section->offset - r->base >= (u64)(r->end - r->begin)) {
+		log_error("vson: section %s isn't loaded", label);
+		return false;
+	}
+	r->p = r->begin + (section->offset - r->base);
+	return true;
+}
+
+b32 vson_reader_load_section(vson_reader_t *r, FILE *fp, const char *label,
+                             allocator_t *a)
 {
-	char c;
-	if (vson__read_label(fp, label) && (c = fgetc(fp)) != EOF) {
-		*val = c != '0' && c != 'f';
+	char footer[VSON__TEXT_FOOTER_SZ], magic[VSON__BINARY_MAGIC_SZ];
+	vson_format_t format = VSON_TEXT;
+	const vson__section_t *section;
+	u64 index_off, sec_off, sec_end;
+	size_t sec_sz, idx_sz, footer_sz;
+	char *buf;
+	s64 sz;
+
+	vson_reader_init(r, NULL, 0);
+	if (vson__fseek(fp, 0, SEEK_END) != 0 || (sz = vson__ftell(fp)) < 0)
+		goto err;
+	rewind(fp);
+	if (   fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+	    && memcmp(magic, VSON__BINARY_MAGIC, VSON__BINARY_MAGIC_SZ) == 0)
+		format = VSON_BINARY;
+
+	footer_sz = (size_t)sz < sizeof(footer) ? (size_t)sz : sizeof(footer);
+	if (   vson__fseek(fp, sz - (s64)footer_sz, SEEK_SET) != 0
+	    || fread(footer, 1, footer_sz, fp) != footer_sz)
+		goto err;
+	footer_sz = vson__footer(footer + footer_sz, footer_sz, format, &index_off);
+	if (!footer_sz || index_off > (u64)sz - footer_sz) {
+		log_error("vson: no index to find %s", label);
+		return false;
+	}
+
+	/* find the section from the index alone, then read it in front of it */
+	idx_sz = (size_t)((u64)sz - footer_sz - index_off);
+	buf = amalloc(idx_sz + 1, a);
+	error_if(!buf, "vson: oom");
+	r->owned     = buf;
+	r->allocator = a;
+	r->format    = format;
+	r->index     = buf;
+	r->index_end = buf + idx_sz;
+	if (   vson__fseek(fp, (s64)index_off, SEEK_SET) != 0
+	    || fread(buf, 1, idx_sz, fp) != idx_sz)
+		goto err;
+	if (!vson__parse_index(r) || !(section = vson__find_section(r, label)))
+		goto fail;
+	sec_off = section->offset;
+	sec_end = index_off;
+	array_foreach(r->sections, const vson__section_t, s)
+		if (s->offset > sec_off && s->offset < sec_end)
+			sec_end = s->offset;
+	if (sec_off > index_off)
+		goto fail;
+
+	sec_sz = (size_t)(sec_end - sec_off);
+	buf = arealloc(buf, sec_sz + idx_sz + 1, a);
+	error_if(!buf, "vson: oom");
+	memmove(buf + sec_sz, buf, idx_sz);
+	r->owned     = buf;
+	r->p         = buf;
+	r->begin     = buf;
+	r->end       = buf + sec_sz;
+	r->base      = sec_off;
+	r->index     = r->end;
+	r->index_end = r->end + idx_sz;
+	if (   vson__fseek(fp, (s64)sec_off, SEEK_SET) != 0
+	    || fread(buf, 1, sec_sz, fp) != sec_sz)
+		goto err;
+	/* the labels point into the index, which moved */
+	if (vson__parse_index(r))
 		return true;
+	goto fail;
+
+err:
+	log_error("vson: failed reading section %s", label);
+fail:
+	vson_reader_destroy(r);
+	return false;
+}
+
+/* Parallel loading */
+
+/* appends the start of every section to starts */
+static void vson__split_text(const vson_reader_t *doc, const char *label,
+                             array(const char*) *starts)
+{
+	const size_t len = strlen(label);
+	const char *p = doc->p, *end = doc->end;
+
+	while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+		++p;
+	/* a header is the only record after a blank line */
+	for (const char *h = p; h; ) {
+		if ((size_t)(end - h) > len && memcmp(h, label, len) == 0 && h[len] == ':')
+			array_append(*starts, h);
+		while ((h = memchr(h, '\n', end - h)) != NULL) {
+			++h;
+			if (h != end && *h == '\r')
+				++h;
+			if (h != end && *h == '\n') {
+				while (h != end && (*h == ' ' || *h == '\n' || *h == '\r' || *h == '\t'))
+					++h;
+				break;
+			}
+		}
 	}
+}
+
+/* also collects every label, since sections use ids defined before them */
+static b32 vson__split_binary(vson_reader_t *doc, const char *label,
+                               array(const char*) *starts)
+{
+	const char *p = doc->p, *end = doc->end;
+	allocator_t *a = doc->allocator ? doc->allocator : g_allocator;
 
-	vson__skip_rest_of_line(fp);
+	if (!doc->labels)
+		doc->labels = array_create_ex(a);
+	while (p != end) {
+		u16 id;
+		u8 tag;
+		u64 sz;
+		if ((u8)*p == VSON__TAG_LABEL) {
+			vson__label_t *def;
+			if (end - p < 2 || end - p < 2 + (u8)p[1])
+				goto corrupt;
+			def = array_append_null(doc->labels);
+			def->str = p + 2;
+			def->len = (u8)p[1];
+			def->hash = hashn(def->str, def->len);
+			p += 2 + def->len;
+			continue;
+		}
+		if (end - p < 3)
+			goto corrupt;
+		tag = (u8)p[0];
+		memcpy(&id, p + 1, sizeof(id));
+		if (tag <= VSON__TAG_LABEL || tag >= VSON__TAG_COUNT || id >= array_sz(doc->labels))
+			goto corrupt;
+		if (!vson__bin_payload_sz(p, end, tag, &sz))
+			goto corrupt;
+		if (tag == VSON__TAG_HEADER && vson__label_eq(&doc->labels[id], label))
+			array_append(*starts, p);
+		p += 3 + sz;
+	}
+	doc->labels_indexed = true;
+	return true;
+
+corrupt:
+	log_error("vson: corrupt record after %" PRIu64 " bytes",
+	          (u64)(p - doc->begin));
+	doc->labels_indexed = true;
 	return false;
 }
 
-#define VSON_READ_VAL(expr) \
-	char buf[VSON_VALUE_SZ]; \
-	if (!vson__read_label(fp, label)) { \
-		vson__skip_rest_of_line(fp); \
-		return false; \
-	} \
-	if (!vson__read_rest_of_line(fp, buf, VSON_VALUE_SZ)) \
-		return false; \
-	*val = expr; \
+typedef struct vson__load_job
+{
+	const vson_reader_t *doc;
+	array(const char*) starts; /* of each section, then the end */
+	vson_section_f load;
+	u8 *results;
+	size_t result_sz;
+	void *udata;
+	size_t next, failed;       /* atomic */
+} vson__load_job_t;
+
+static void vson__load_job_run(vson__load_job_t *job)
+{
+	const size_t n = array_sz(job->starts) - 1;
+	size_t i;
+	while ((i = vlt_atomic_add(&job->next, 1)) < n) {
+		const temp_memory_mark_t mark = temp_memory_save(g_temp_allocator);
+		vson_reader_t r = *job->doc;
+		r.p     = job->starts[i];
+		r.end   = job->starts[i+1];
+		r.index = NULL;
+		if (!job->load(&r, job->results + i * job->result_sz, job->udata))
+			vlt_atomic_add(&job->failed, 1);
+		temp_memory_restore(mark);
+	}
+}
+
+static int vson__load_worker(void *udata)
+{
+	vlt_init(VLT_THREAD_WORKER);
+	vson__load_job_run(udata);
+	vlt_destroy(VLT_THREAD_WORKER);
+	return 0;
+}
+
+b32 vson__load_sections(const char *fname, const char *label, vson_section_f load,
+                        void **results, size_t result_sz, void *udata,
+                        u32 n_threads)
+{
+	vson__load_job_t job;
+	vson_reader_t doc;
+	array(thread_t) threads;
+	size_t sz, n, first;
+	b32 ok = true;
+	void *map = file_map(fname, &sz);
+	if (!map)
+		return false;
+
+	vson_reader_init(&doc, map, sz);
+	array_init(job.starts, 64);
+	if (doc.index && (doc.sections || vson__parse_index(&doc))) {
+		/* sections must lie inside the document, in order */
+		array_foreach(doc.sections, const vson__section_t, section) {
+			const char *start;
+			if (!vson__label_eq(&section->label, label))
+				continue;
+			if (   section->offset < doc.base
+			    || section->offset - doc.base >= (u64)(doc.end - doc.begin)) {
+				log_error("vson: section %s is outside the document", label);
+				ok = false;
+				break;
+			}
+			start = doc.begin + (section->offset - doc.base);
+			if (!array_empty(job.starts) && start <= array_last(job.starts)) {
+				log_error("vson: sections %s are out of order in the index", label);
+				ok = false;
+				break;
+			}
+			array_append(job.starts, start);
+		}
+	} else if (doc.format == VSON_BINARY) {
+		ok = vson__split_binary(&doc, label, &job.starts);
+	} else {
+		vson__split_text(&doc, label, &job.starts);
+	}
+	if (!ok)
+		goto out;
+	array_append(job.starts, doc.end);
+	n = array_sz(job.starts) - 1;
+
+	first = array_sz(*results);
+	*results = array__reserve(*results, first + n, result_sz  MEMCALL_LOCATION);
+	array_sz(*results) = first + n;
+	memset((u8*)*results + first * result_sz, 0, n * result_sz);
+
+	job.doc       = &doc;
+	job.load      = load;
+	job.results   = (u8*)*results + first * result_sz;
+	job.result_sz = result_sz;
+	job.udata     = udata;
+	job.next      = 0;
+	job.failed    = 0;
+
+	if (!n_threads)
+		n_threads = cpu_count();
+	if (n_threads > n)
+		n_threads = (u32)n;
+	array_init(threads, n_threads);
+	for (u32 i = 1; i < n_threads; ++i) {
+		thread_t thread;
+		if (thread_create(&thread, vson__load_worker, &job))
+			array_append(threads, thread);
+	}
+	vson__load_job_run(&job);
+	array_foreach(threads, thread_t, thread)
+		thread_join(*thread);
+
+	array_destroy(threads);
+	ok = job.failed == 0;
+
+out:
+	array_destroy(job.starts);
+	vson_reader_destroy(&doc);
+	file_unmap(map, sz);
+	return ok;
+}
+
+/* Stream API */
+
+#define VSON__LINE_SZ (VSON_LABEL_SZ + VSON_VALUE_SZ + 4)
+
+/* reads the next non-blank line into buf for r to parse */
+static b32 vson__read_line(FILE *fp, char *buf, u32 n, vson_reader_t *r)
+{
+	int c;
+	size_t len;
+	while ((c = fgetc(fp)) != EOF && isspace(c))
+		;
+	if (c == EOF || ungetc(c, fp) == EOF || !fgets(buf, n, fp)) {
+		vson_reader_init(r, buf, 0);
+		return true; /* let the reader report the missing label */
+	}
+	len = strlen(buf);
+	if (len == n - 1 && buf[len-1] != '\n') {
+		while ((c = fgetc(fp)) != EOF && c != '\n')
+			;
+		return false;
+	}
+	vson_reader_init(r, buf, len);
 	return true;
+}
+
+#define VSON__READ(get, ...) \
+	char buf[VSON__LINE_SZ]; \
+	vson_reader_t r; \
+	return vson__read_line(fp, buf, VSON__LINE_SZ, &r) && get(&r, __VA_ARGS__);
+
+b32 vson_read_header(FILE *fp, const char *label)
+{
+	VSON__READ(vson_get_header, label)
+}
+
+b32 vson_read_b8(FILE *fp, const char *label, b8 *val)
+{
+	VSON__READ(vson_get_b8, label, val)
+}
+
+b32 vson_read_u8(FILE *fp, const char *label, u8 *val)
+{
+	VSON__READ(vson_get_u8, label, val)
+}
+
+b32 vson_read_s8(FILE *fp, const char *label, s8 *val)
+{
+	VSON__READ(vson_get_s8, label, val)
+}
+
+b32 vson_read_u16(FILE *fp, const char *label, u16 *val)
+{
+	VSON__READ(vson_get_u16, label, val)
+}
+
+b32 vson_read_s16(FILE *fp, const char *label, s16 *val)
+{
+	VSON__READ(vson_get_s16, label, val)
+}
+
+b32 vson_read_b32(FILE *fp, const char *label, b32 *val)
+{
+	VSON__READ(vson_get_b32, label, val)
+}
 
 b32 vson_read_s32(FILE *fp, const char *label, s32 *val)
 {
-	VSON_READ_VAL(strtol(buf, NULL, 10))
+	VSON__READ(vson_get_s32, label, val)
 }
 
 b32 vson_read_u32(FILE *fp, const char *label, u32 *val)
 {
-	VSON_READ_VAL(strtoul(buf, NULL, 10))
+	VSON__READ(vson_get_u32, label, val)
 }
 
 b32 vson_read_r32(FILE *fp, const char *label, r32 *val)
 {
-	VSON_READ_VAL(strtof(buf, NULL))
+	VSON__READ(vson_get_r32, label, val)
 }
 
 b32 vson_read_r64(FILE *fp, const char *label, r64 *val)
 {
-	VSON_READ_VAL(strtod(buf, NULL))
+	VSON__READ(vson_get_r64, label, val)
 }
 
 b32 vson_read_str(FILE *fp, const char *label, char *val, u32 sz)
 {
-	char c = 0, *p = val;
+	const u32 n = VSON_LABEL_SZ + sz + 4;
+	char *buf = amalloc(n, g_allocator);
+	vson_reader_t r;
+	b32 ret;
+	error_if(!buf, "vson: oom");
+	ret =    vson__read_line(fp, buf, n, &r)
+	      && vson_get_str(&r, label, val, sz);
+	afree(buf, g_allocator);
+	return ret;
+}
 
-	if (!vson__read_label(fp, label)) {
-		vson__skip_rest_of_line(fp);
-		return false;
+b32 vson_read_r32_array(FILE *fp, const char *label, r32 *vals, u32 cap, u32 *n)
+{
+	const u32 max_n = cap < VSON_ARRAY_MAX_N ? cap : VSON_ARRAY_MAX_N;
+	const size_t sz = VSON_LABEL_SZ + 4 + vson__r32_array_max_sz(max_n, VSON_ARRAY_DECIMAL);
+	char *buf = amalloc(sz, g_allocator);
+	vson_reader_t r;
+	b32 ret;
+	error_if(!buf, "vson: oom");
+	ret =    vson__read_line(fp, buf, (u32)sz, &r)
+	      && vson_get_r32_array(&r, label, vals, cap, n);
+	afree(buf, g_allocator);
+	return ret;
+}
+
+b32 vson_read_struct(FILE *fp, void *s, const vson_field_t *fields, u32 n)
+{
+	u32 line_sz = VSON__LINE_SZ;
+	char *buf;
+	b32 ret = true;
+	for (u32 i = 0; i < n; ++i) {
+		const u32 str_line_sz = VSON_LABEL_SZ + (u32)fields[i].sz + 4;
+		if (fields[i].type == VSON_FIELD_STR && str_line_sz > line_sz)
+			line_sz = str_line_sz;
+	}
+	buf = amalloc(line_sz, g_allocator);
+	error_if(!buf, "vson: oom");
+	for (u32 i = 0; i < n && ret; ) {
+		const s64 pos = vson__ftell(fp);
+		vson_reader_t r;
+		b32 end = false;
+		ret =    vson__read_line(fp, buf, line_sz, &r)
+		      && vson__get_struct_record(&r, s, fields, n, &i, &end);
+		/* give the line after the struct back */
+		if (end) {
+			ret = pos != -1 && vson__fseek(fp, pos, SEEK_SET) == 0;
+			break;
+		}
 	}
+	afree(buf, g_allocator);
+	return ret;
+}
 
-	while ((u32)(p - val) < sz && (c = fgetc(fp)) != EOF && c != '\n')
-		*(p++) = c;
-	if (p > val && p[-1] == '\r')
-		*(--p) = '\0';
-	if (p == val + sz)
-		c = fgetc(fp);
-	else
-		*p = '\0';
-	return c == '\r' || c == '\n';
+b32 vson_read_v2f_array(FILE *fp, const char *label, v2f *vals, u32 cap, u32 *n)
+{
+	const u32 max_n = cap < VSON_ARRAY_MAX_N / 2 ? cap * 2 : VSON_ARRAY_MAX_N;
+	const size_t sz = VSON_LABEL_SZ + 4 + vson__r32_array_max_sz(max_n, VSON_ARRAY_DECIMAL);
+	char *buf = amalloc(sz, g_allocator);
+	vson_reader_t r;
+	b32 ret;
+	error_if(!buf, "vson: oom");
+	ret =    vson__read_line(fp, buf, (u32)sz, &r)
+	      && vson_get_v2f_array(&r, label, vals, cap, n);
+	afree(buf, g_allocator);
+	return ret;
 }
 
 
@@ -224,34 +1799,318 @@ void vson_write_header(FILE *fp, const char *label)
 	fprintf(fp, "\n%s: \n", label);
 }
 
+static void vson__write_val(FILE *fp, const char *label, const char *val, u32 len)
+{
+	fputs(label, fp);
+	fputs(": ", fp);
+	fwrite(val, 1, len, fp);
+	fputc('\n', fp);
+}
+
 void vson_write_b32(FILE *fp, const char *label, b32 val)
 {
-	fprintf(fp, "%s: %c\n", label, val ? 't' : 'f');
+	vson__write_val(fp, label, val ? "t" : "f", 1);
 }
 
 void vson_write_s32(FILE *fp, const char *label, s32 val)
 {
-	fprintf(fp, "%s: %d\n", label, val);
+	char buf[FMT_INT_SZ];
+	vson__write_val(fp, label, buf, fmt_s64(buf, val, 0));
 }
 
 void vson_write_u32(FILE *fp, const char *label, u32 val)
 {
-	fprintf(fp, "%s: %u\n", label, val);
+	char buf[FMT_INT_SZ];
+	vson__write_val(fp, label, buf, fmt_u64(buf, val, 0));
 }
 
 void vson_write_r32(FILE *fp, const char *label, r32 val)
 {
-	fprintf(fp, "%s: %f\n", label, val);
+	char buf[FMT_REAL_SZ];
+	vson__write_val(fp, label, buf, fmt_r32(buf, val));
 }
 
 void vson_write_r64(FILE *fp, const char *label, r64 val)
 {
-	fprintf(fp, "%s: %f\n", label, val);
+	char buf[FMT_REAL_SZ];
+	vson__write_val(fp, label, buf, fmt_r64(buf, val));
 }
 
 void vson_write_str(FILE *fp, const char *label, const char *val)
 {
-	fprintf(fp, "%s: %s\n", label, val);
+	vson__write_val(fp, label, val, (u32)strlen(val));
+}
+
+void vson_write_r32_array(FILE *fp, const char *label, const r32 *vals, u32 n,
+                          vson_array_encoding_t enc)
+{
+	char *buf;
+	if (!vson__array_fits(label, n))
+		return;
+	buf = amalloc(vson__r32_array_max_sz(n, enc), g_allocator);
+	error_if(!buf, "vson: oom");
+	vson__write_val(fp, label, buf, vson__fmt_r32_array(buf, vals, n, enc));
+	afree(buf, g_allocator);
+}
+
+void vson_write_v2f_array(FILE *fp, const char *label, const v2f *vals, u32 n,
+                          vson_array_encoding_t enc)
+{
+	if (vson__array_fits(label, (u64)n * 2))
+		vson_write_r32_array(fp, label, (const r32*)vals, n * 2, enc);
+}
+
+void vson_write_struct(FILE *fp, const void *s, const vson_field_t *fields, u32 n)
+{
+	VSON__PUT_STRUCT(vson_write, fp, s, fields, n)
+}
+
+/* Writer */
+
+void vson_writer_init(vson_writer_t *w, FILE *fp, vson_format_t format)
+{
+	vson_writer_init_ex(w, fp, format, g_allocator);
+}
+
+void vson_writer_init_ex(vson_writer_t *w, FILE *fp, vson_format_t format,
+                         allocator_t *a)
+{
+	w->fp      = fp;
+	w->format  = format;
+	w->flushed = 0;
+	w->index   = NULL;
+	array_init_ex(w->buf, 4096, a);
+	atom_table_init_ex(&w->labels, a);
+	if (format == VSON_BINARY)
+		array_append_n(w->buf, VSON__BINARY_MAGIC, VSON__BINARY_MAGIC_SZ);
+}
+
+void vson_writer_index_headers(vson_writer_t *w)
+{
+	if (!w->index)
+		w->index = array_create_ex(array__allocator(w->buf));
+}
+
+b32 vson_writer_flush(vson_writer_t *w)
+{
+	if (w->fp && !array_empty(w->buf)) {
+		const size_t sz = array_sz(w->buf);
+		const size_t n = fwrite(w->buf, 1, sz, w->fp);
+		array_clear(w->buf);
+		w->flushed += sz;
+		return n == sz;
+	}
+	return true;
+}
+
+/* returns room for n more chars at the end of the buffer */
+static char *vson__reserve(vson_writer_t *w, u32 n)
+{
+	if (w->fp && array_sz(w->buf) + n > VSON_WRITER_FLUSH_SZ)
+		vson_writer_flush(w);
+	w->buf = array__grow_n(w->buf, n, 1  MEMCALL_LOCATION);
+	return array_end(w->buf);
+}
+
+static void vson__put(vson_writer_t *w, const void *src, u32 n)
+{
+	memcpy(vson__reserve(w, n), src, n);
+	array_sz(w->buf) += n;
+}
+
+/* appends "label: ", leaving room for extra more chars */
+static char *vson__put_label(vson_writer_t *w, const char *label, u32 extra)
+{
+	const u32 len = (u32)strlen(label);
+	char *p = vson__reserve(w, len + 2 + extra);
+	memcpy(p, label, len);
+	p[len]   = ':';
+	p[len+1] = ' ';
+	array_sz(w->buf) += len + 2;
+	return p + len + 2;
+}
+
+static void vson__put_text(vson_writer_t *w, const char *label, const char *val, u32 len)
+{
+	char *p = vson__put_label(w, label, len + 1);
+	memcpy(p, val, len);
+	p[len] = '\n';
+	array_sz(w->buf) += len + 1;
+}
+
+#define VSON__PUT_FMT(w, label, max_sz, fmt_expr) \
+	do { \
+		char *buf = vson__put_label(w, label, (max_sz) + 1); \
+		const u32 len = fmt_expr; \
+		buf[len] = '\n'; \
+		array_sz((w)->buf) += len + 1; \
+	} while (0)
+
+static void vson__put_record(vson_writer_t *w, const char *label, u8 tag,
+                             const void *payload, u32 sz)
+{
+	const u32 n = atom_count(&w->labels);
+	const atom_t atom = atom_intern(&w->labels, label);
+	u8 rec[3];
+	u16 id;
+	if (atom_count(&w->labels) != n) {
+		const u32 len = atom_len(&w->labels, atom);
+		u8 def[2] = { VSON__TAG_LABEL, (u8)len };
+		error_if(len > UINT8_MAX || atom > VSON__MAX_LABELS, "vson: too many labels");
+		vson__put(w, def, sizeof(def));
+		vson__put(w, label, len);
+	}
+	id = (u16)(atom - 1);
+	rec[0] = tag;
+	memcpy(rec + 1, &id, sizeof(id));
+	vson__put(w, rec, sizeof(rec));
+	if (sz)
+		vson__put(w, payload, sz);
+}
+
+void vson_put_header(vson_writer_t *w, const char *label)
+{
+	const u64 offset = w->flushed + array_sz(w->buf);
+	if (w->format == VSON_BINARY) {
+		vson__put_record(w, label, VSON__TAG_HEADER, NULL, 0);
+	} else {
+		vson__put(w, "\n", 1);
+		vson__put_text(w, label, "", 0);
+	}
+	if (w->index) {
+		vson__index_entry_t *entry = array_append_null(w->index);
+		entry->label  = atom_intern(&w->labels, label);
+		entry->offset = offset;
+	}
+}
+
+void vson_put_b32(vson_writer_t *w, const char *label, b32 val)
+{
+	const u8 b = val != 0;
+	if (w->format == VSON_BINARY)
+		vson__put_record(w, label, VSON__TAG_B32, &b, sizeof(b));
+	else
+		vson__put_text(w, label, b ? "t" : "f", 1);
+}
+
+void vson_put_s32(vson_writer_t *w, const char *label, s32 val)
+{
+	if (w->format == VSON_BINARY)
+		vson__put_record(w, label, VSON__TAG_S32, &val, sizeof(val));
+	else
+		VSON__PUT_FMT(w, label, FMT_INT_SZ, fmt_s64(buf, val, 0));
+}
+
+void vson_put_u32(vson_writer_t *w, const char *label, u32 val)
+{
+	if (w->format == VSON_BINARY)
+		vson__put_record(w, label, VSON__TAG_U32, &val, sizeof(val));
+	else
+		VSON__PUT_FMT(w, label, FMT_INT_SZ, fmt_u64(buf, val, 0));
+}
+
+void vson_put_r32(vson_writer_t *w, const char *label, r32 val)
+{
+	if (w->format == VSON_BINARY)
+		vson__put_record(w, label, VSON__TAG_R32, &val, sizeof(val));
+	else
+		VSON__PUT_FMT(w, label, FMT_REAL_SZ, fmt_r32(buf, val));
+}
+
+void vson_put_r64(vson_writer_t *w, const char *label, r64 val)
+{
+	if (w->format == VSON_BINARY)
+		vson__put_record(w, label, VSON__TAG_R64, &val, sizeof(val));
+	else
+		VSON__PUT_FMT(w, label, FMT_REAL_SZ, fmt_r64(buf, val));
+}
+
+void vson_put_str(vson_writer_t *w, const char *label, const char *val)
+{
+	const u32 len = (u32)strlen(val);
+	if (w->format == VSON_BINARY) {
+		vson__put_record(w, label, VSON__TAG_STR, &len, sizeof(len));
+		vson__put(w, val, len);
+	} else {
+		vson__put_text(w, label, val, len);
+	}
+}
+
+void vson_put_r32_array(vson_writer_t *w, const char *label, const r32 *vals,
+                        u32 n, vson_array_encoding_t enc)
+{
+	if (!vson__array_fits(label, n))
+		return;
+	if (w->format == VSON_BINARY) {
+		vson__put_record(w, label, VSON__TAG_R32_ARRAY, &n, sizeof(n));
+		if (n)
+			vson__put(w, vals, n * sizeof(r32));
+	} else {
+		VSON__PUT_FMT(w, label, (u32)vson__r32_array_max_sz(n, enc),
+		              vson__fmt_r32_array(buf, vals, n, enc));
+	}
+}
+
+void vson_put_v2f_array(vson_writer_t *w, const char *label, const v2f *vals,
+                        u32 n, vson_array_encoding_t enc)
+{
+	if (vson__array_fits(label, (u64)n * 2))
+		vson_put_r32_array(w, label, (const r32*)vals, n * 2, enc);
+}
+
+void vson_put_struct(vson_writer_t *w, const void *s, const vson_field_t *fields,
+                     u32 n)
+{
+	VSON__PUT_STRUCT(vson_put, w, s, fields, n)
+}
+
+static void vson__put_index(vson_writer_t *w)
+{
+	const u64 index_off = w->flushed + array_sz(w->buf);
+	const u32 n = array_sz(w->index);
+	if (w->format == VSON_BINARY) {
+		const u32 n_labels = atom_count(&w->labels);
+		vson__put(w, &n_labels, sizeof(n_labels));
+		for (atom_t atom = 1; atom <= n_labels; ++atom) {
+			const u8 len = (u8)atom_len(&w->labels, atom);
+			vson__put(w, &len, sizeof(len));
+			vson__put(w, atom_str(&w->labels, atom), len);
+		}
+		vson__put(w, &n, sizeof(n));
+		array_foreach(w->index, const vson__index_entry_t, entry) {
+			const u16 id = (u16)(entry->label - 1);
+			vson__put(w, &id, sizeof(id));
+			vson__put(w, &entry->offset, sizeof(entry->offset));
+		}
+		vson__put(w, &index_off, sizeof(index_off));
+		vson__put(w, VSON__INDEX_MAGIC, 4);
+	} else {
+		char *p;
+		u64 off = index_off;
+		VSON__PUT_FMT(w, VSON__INDEX_LABEL, FMT_INT_SZ, fmt_u64(buf, n, 0));
+		array_foreach(w->index, const vson__index_entry_t, entry)
+			VSON__PUT_FMT(w, atom_str(&w->labels, entry->label), FMT_INT_SZ,
+			              fmt_u64(buf, entry->offset, 0));
+		/* fixed width, so readers find it from the end */
+		p = vson__put_label(w, VSON__INDEX_AT_LABEL, VSON__INDEX_AT_DIGITS + 1);
+		for (u32 i = VSON__INDEX_AT_DIGITS; i-- > 0; off /= 10)
+			p[i] = '0' + off % 10;
+		p[VSON__INDEX_AT_DIGITS] = '\n';
+		array_sz(w->buf) += VSON__INDEX_AT_DIGITS + 1;
+	}
+}
+
+b32 vson_writer_destroy(vson_writer_t *w)
+{
+	b32 ret;
+	if (w->index) {
+		vson__put_index(w);
+		array_destroy(w->index);
+	}
+	ret = vson_writer_flush(w);
+	array_destroy(w->buf);
+	atom_table_destroy(&w->labels);
+	return ret;
 }
 
 #undef VSON_IMPLEMENTATION